@@ -1,6 +1,20 @@
 #ifndef LVGL_DISPLAY_H
 #define LVGL_DISPLAY_H
 
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+/*
+ * Wakes the display thread, which otherwise sleeps until LVGL's next
+ * timer deadline. Producers post a bit after handing over their data.
+ */
+#define UI_EVENT_MQTT_STATE     BIT(0)
+#define UI_EVENT_MQTT_ATTEMPT   BIT(1)
+#define UI_EVENT_INPUT          BIT(2)
+#define UI_EVENT_ANY            (UI_EVENT_MQTT_STATE | UI_EVENT_MQTT_ATTEMPT | UI_EVENT_INPUT)
+
+extern struct k_event ui_events;
+
 extern int run_lvgl_display(void);
 
-#endif // LVGL_DISPLAY_H
\ No newline at end of file
+#endif // LVGL_DISPLAY_H
@@ -2,11 +2,19 @@
 #define MQTT_CLIENT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 /** MQTT connection timeouts */
 #define MSECS_NET_POLL_TIMEOUT	5000
-#define MSECS_WAIT_RECONNECT	1000
+#define MSECS_WAIT_RECONNECT	1000	/* first reconnect delay, doubled per failure */
+#define MSECS_MAX_RECONNECT		60000
+/* Consecutive failed connects before the cached broker address is looked up again */
+#define MQTT_RESOLVE_AFTER_FAILURES	3
+
+/* Publish payloads are read in chunks; anything past MQTT_PAYLOAD_MAX is skipped */
+#define MQTT_PAYLOAD_CHUNK_SIZE	256
+#define MQTT_PAYLOAD_MAX		16384
 
 #define MQTT_TOPIC "topic/test/esp32_sub"
 #define CLIENT_ID "esp32_sub"
@@ -17,7 +25,12 @@
 // #define MQTT_USERNAME "slarm"
 // #define MQTT_PASSWORD "Slarmiscool1"
 
+#if defined(CONFIG_BOARD_NATIVE_SIM)
+// Local mosquitto on the host end of the native_sim TAP interface
+#define MQTT_BROKER_ADDR "192.0.2.2"
+#else
 #define MQTT_BROKER_ADDR "broker.hivemq.com"
+#endif
 #define MQTT_BROKER_PORT 1883
 
 #define MQTT_USERNAME NULL
@@ -25,10 +38,7 @@
 
 extern int start_mqtt_client(void);
 
-extern struct k_fifo mqtt_lvgl_fifo;  // FIFO for MQTT data
-
 typedef struct {
-    void *fifo_reserved;  // Needed by Zephyr FIFO (must be first)
     bool open;
     bool locked;
     bool motion_detected;
@@ -41,4 +51,19 @@ typedef struct {
     char air_quality[10];  // Assuming a max length for air quality
 } mqtt_lvgl_data_t;
 
+/* An unlock attempt, queued so the log never misses one between UI refreshes */
+struct mqtt_attempt_event {
+    char face_name[15];
+    bool face_validated;
+    bool pin_validated;
+    bool open;
+};
+
+#define MQTT_ATTEMPT_QUEUE_LEN 8
+
+extern struct k_msgq mqtt_attempt_q;  // struct mqtt_attempt_event
+
+/* Copy out the newest state if it changed since *seen_gen; returns true if it did */
+bool mqtt_lvgl_state_get(mqtt_lvgl_data_t *out, uint32_t *seen_gen);
+
 #endif // MQTT_CONFIG_H
\ No newline at end of file
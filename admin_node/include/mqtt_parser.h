@@ -0,0 +1,48 @@
+#ifndef MQTT_PARSER_H
+#define MQTT_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "mqtt_client.h"
+
+/* Longest triple that can be split across two payload chunks */
+#define MQTT_PARSER_TRIPLE_MAX  96
+
+/*
+ * Incremental parser for "[device,key,value],[device,key,value],..."
+ * payloads that arrive in chunks. Triples that sit inside one chunk are
+ * parsed straight out of it; only a triple cut off by the end of a chunk
+ * is copied, into carry, until its ']' arrives. A split triple longer
+ * than MQTT_PARSER_TRIPLE_MAX is skipped.
+ */
+struct mqtt_parser {
+    mqtt_lvgl_data_t *data;
+    char carry[MQTT_PARSER_TRIPLE_MAX];
+    size_t carry_len;
+    bool in_triple;
+    bool carry_overflow;
+    int32_t eco2;
+    int32_t etvoc;
+    bool eco2_received;
+    bool etvoc_received;
+    bool face_name_received;
+};
+
+void mqtt_parser_begin(struct mqtt_parser *parser, mqtt_lvgl_data_t *data);
+void mqtt_parser_feed(struct mqtt_parser *parser, const char *buf, size_t len);
+/*
+ * Derive the fields that depend on the whole payload: face_validated
+ * when it carried `person`, air_quality when it carried both `eCO2` and
+ * `eTVOC`. Otherwise they keep their previous values.
+ */
+void mqtt_parser_end(struct mqtt_parser *parser);
+
+/*
+ * Parse a whole payload in one pass, straight out of the buffer it was
+ * received into. The buffer is not modified and does not need a NUL
+ * terminator; only string fields that end up in data are copied.
+ */
+void mqtt_parse_triples(const char *buf, size_t len, mqtt_lvgl_data_t *data);
+
+#endif // MQTT_PARSER_H
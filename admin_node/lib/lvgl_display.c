@@ -13,6 +13,8 @@
 #include <string.h>
 #include <zephyr/kernel.h>
 #include <lvgl_input_device.h>
+#include <zephyr/input/input.h>
+#include <zephyr/shell/shell.h>
 
 #define LOG_LEVEL CONFIG_LOG_DEFAULT_LEVEL
 #include <zephyr/logging/log.h>
@@ -20,6 +22,7 @@
 // #include <lvgl.h>
 #include <stdio.h>
 
+#include "lvgl_display.h"
 #include "mqtt_client.h"
 
 // #include "lv_symbol_def.h"
@@ -486,17 +489,22 @@ lv_obj_t *create_sensor_screen(void) {
     return scr;
 }
 
-void update_sensor_data(char* temp, char* humidity, char* air_quality) {
-
+void update_temperature(const char *temp) {
     char buf[32];
-    
-    // Update temperature
+
     snprintf(buf, sizeof(buf), LV_SYMBOL_HOME " Temp: %s°C", temp);
     lv_label_set_text(temp_box, buf);
+}
+
+void update_humidity(const char *humidity) {
+    char buf[32];
 
-    // Update humidity
     snprintf(buf, sizeof(buf),  LV_SYMBOL_DROPLET " Humidity: %s %%", humidity);
     lv_label_set_text(humidity_box, buf);
+}
+
+void update_air_quality(const char *air_quality) {
+    char buf[32];
 
     // // Update air quality
     // if (air_quality <= 50) {
@@ -508,10 +516,132 @@ void update_sensor_data(char* temp, char* humidity, char* air_quality) {
     // }
     snprintf(buf, sizeof(buf), LV_SYMBOL_WARNING " Air Quality: %s", air_quality);
     lv_label_set_text(air_box, buf);
+}
 
-    // lv_chart_set_next_value(sensor_chart, temp_series, temp);
-    // lv_chart_set_next_value(sensor_chart, humidity_series, humidity);
-    // lv_chart_set_next_value(sensor_chart, air_quality_series, air_quality);
+/*
+ * What the widgets currently show. Every lv_label_set_text or style
+ * change invalidates the widget and costs an SPI flush, so a new state
+ * only touches the widgets whose value actually differs.
+ */
+static mqtt_lvgl_data_t shown;
+static bool shown_valid;
+
+/* Widget groups apply_state() can update per snapshot */
+#define UI_WIDGET_COUNT 9
+
+#define FIELD_CHANGED(field) \
+    (!shown_valid || shown.field != state->field)
+#define STR_CHANGED(field) \
+    (!shown_valid || strcmp(shown.field, state->field) != 0)
+
+/* Redraw statistics: frames from the display driver's monitor callback */
+static struct {
+    uint32_t frames;
+    uint32_t frame_ms_total;
+    uint32_t frame_ms_max;
+    uint64_t pixels;
+    uint32_t states;            /* snapshots applied */
+    uint32_t widget_updates;    /* widgets that actually changed */
+    uint32_t wakeups;           /* passes through the main loop, by cause below */
+    uint32_t wake_mqtt;
+    uint32_t wake_input;
+    uint32_t wake_timer;        /* an LVGL timer fell due */
+    int64_t since;              /* uptime at the last reset, in ms */
+} ui_stats;
+
+#define UPDATE_IF(changed, update) \
+    do { \
+        if (changed) { \
+            update; \
+            ui_stats.widget_updates++; \
+        } \
+    } while (0)
+
+static void apply_state(const mqtt_lvgl_data_t *state) {
+    UPDATE_IF(FIELD_CHANGED(locked), update_door_status(state->locked));
+    UPDATE_IF(FIELD_CHANGED(open), update_door_position(state->open));
+    UPDATE_IF(FIELD_CHANGED(motion_detected), update_motion_detected(state->motion_detected));
+    UPDATE_IF(STR_CHANGED(face_name) || FIELD_CHANGED(face_validated),
+              update_face_recognition(state->face_name, state->face_validated));
+    UPDATE_IF(FIELD_CHANGED(pin_validated), update_code_status(state->pin_validated));
+    UPDATE_IF(STR_CHANGED(face_name), update_unlock_attempt(state->face_name));
+    UPDATE_IF(STR_CHANGED(temperature), update_temperature(state->temperature));
+    UPDATE_IF(STR_CHANGED(humidity), update_humidity(state->humidity));
+    UPDATE_IF(STR_CHANGED(air_quality), update_air_quality(state->air_quality));
+
+    shown = *state;
+    shown_valid = true;
+    ui_stats.states++;
+}
+
+/* Called by LVGL after each refresh with its render time and the pixels redrawn */
+static void monitor_cb(lv_disp_drv_t *drv, uint32_t time_ms, uint32_t px) {
+    ui_stats.frames++;
+    ui_stats.frame_ms_total += time_ms;
+    ui_stats.frame_ms_max = MAX(ui_stats.frame_ms_max, time_ms);
+    ui_stats.pixels += px;
+}
+
+static int cmd_ui_stats(const struct shell *sh, size_t argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        memset(&ui_stats, 0, sizeof(ui_stats));
+        ui_stats.since = k_uptime_get();
+        shell_print(sh, "UI stats cleared");
+        return 0;
+    }
+
+    uint32_t frames = ui_stats.frames;
+
+    shell_print(sh, "frames: %u, avg %u ms, max %u ms", frames,
+                frames ? ui_stats.frame_ms_total / frames : 0, ui_stats.frame_ms_max);
+    shell_print(sh, "invalidated: %u kpx total, %u px/frame",
+                (uint32_t)(ui_stats.pixels / 1000),
+                frames ? (uint32_t)(ui_stats.pixels / frames) : 0);
+    shell_print(sh, "states: %u applied, %u widget updates of %u possible",
+                ui_stats.states, ui_stats.widget_updates, ui_stats.states * UI_WIDGET_COUNT);
+
+    uint32_t elapsed_ms = MAX(k_uptime_get() - ui_stats.since, 1);
+
+    shell_print(sh, "wakeups: %u, %u.%02u per second (mqtt %u, input %u, timer %u)",
+                ui_stats.wakeups,
+                (uint32_t)(ui_stats.wakeups * 1000ULL / elapsed_ms),
+                (uint32_t)(ui_stats.wakeups * 100000ULL / elapsed_ms % 100),
+                ui_stats.wake_mqtt, ui_stats.wake_input, ui_stats.wake_timer);
+    return 0;
+}
+SHELL_CMD_REGISTER(ui_stats, NULL,
+    "Dashboard frame time, invalidated area and wakeups: ui_stats [reset]",
+    cmd_ui_stats);
+
+K_EVENT_DEFINE(ui_events);
+
+/* Any input device: the LVGL pointer driver queues the event, this just wakes the loop */
+static void ui_input_cb(struct input_event *evt, void *user_data) {
+    if (evt->sync) {
+        k_event_post(&ui_events, UI_EVENT_INPUT);
+    }
+}
+INPUT_CALLBACK_DEFINE(NULL, ui_input_cb, NULL);
+
+/*
+ * Input devices are read on demand rather than by their periodic LVGL
+ * timer: a touch resumes the read timer and makes it due now, and once
+ * the pointer is released again the timer is paused, so an idle screen
+ * has no timer left that polls.
+ */
+static void indev_wake(void) {
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+        lv_timer_resume(indev->driver->read_timer);
+        lv_timer_ready(indev->driver->read_timer);
+    }
+}
+
+static void indev_idle(void) {
+    for (lv_indev_t *indev = lv_indev_get_next(NULL); indev; indev = lv_indev_get_next(indev)) {
+        if (indev->proc.state == LV_INDEV_STATE_RELEASED) {
+            lv_timer_pause(indev->driver->read_timer);
+        }
+    }
 }
 
 int run_lvgl_display(void) {
@@ -531,52 +661,64 @@ int run_lvgl_display(void) {
 
     load_screen(SCREEN_HOME);
 
+    lv_disp_get_default()->driver->monitor_cb = monitor_cb;
+
     lv_timer_handler();
 	display_blanking_off(display_dev);
 
-    // Main loop
+    mqtt_lvgl_data_t state;
+    uint32_t state_gen = 0;
+    struct mqtt_attempt_event attempt;
+    uint32_t sleep_ms = lv_timer_handler();
+
+    indev_idle();
+    ui_stats.since = k_uptime_get();
+
+    // Main loop: sleep until LVGL's next deadline or until a producer posts
 	while (1) {
+        k_event_wait(&ui_events, UI_EVENT_ANY, false,
+                     sleep_ms == LV_NO_TIMER_READY ? K_FOREVER : K_MSEC(sleep_ms));
+
+        // Take the bits before looking at the data, so a post from here on wakes the next wait
+        uint32_t events = k_event_clear(&ui_events, UI_EVENT_ANY);
+
+        ui_stats.wakeups++;
+        if (events & (UI_EVENT_MQTT_STATE | UI_EVENT_MQTT_ATTEMPT)) {
+            ui_stats.wake_mqtt++;
+        }
+        if (events & UI_EVENT_INPUT) {
+            ui_stats.wake_input++;
+            indev_wake();
+        }
+        if (!events) {
+            ui_stats.wake_timer++;
+        }
+
+        // Only the newest state matters; anything older was overwritten unseen
+        if (mqtt_lvgl_state_get(&state, &state_gen)) {
+            apply_state(&state);
+        }
 
-        mqtt_lvgl_data_t *data = k_fifo_get(&mqtt_lvgl_fifo, K_NO_WAIT);
-        if (data) {
-            // Use the data
-            update_door_status(data->locked);
-            update_door_position(data->open);
-            update_motion_detected(data->motion_detected);
-            update_face_recognition(data->face_name, data->face_validated);
-            update_code_status(data->pin_validated);
-            update_unlock_attempt(data->face_name);
-
-            if (data->new_attempt) {
-
-                char log_buf[64];  // Adjust size if needed
-                char log_buf2[64];  // Adjust size if needed
-
-
-                snprintf(log_buf, sizeof(log_buf), "%s: %s, %s",
-                    data->face_name,
-                    data->face_validated ? "Face Validated" : "Face Rejected",
-                    data->pin_validated ? "PIN Validated" : "PIN Invalid"
-                );
-                add_log_entry(log_buf);
-
-                snprintf(log_buf2, sizeof(log_buf2),
-                    "Door %s", data->open ? "Opened" : "Closed"
-                );
-                add_log_entry(log_buf2);
-            }
-
-            update_sensor_data(data->temperature, data->humidity, data->air_quality);
-            
-            // Update UI accordingly
-
-            // Free memory after processing
-            k_free(data);
-        
+        // Attempts are events, so every queued one gets its log lines
+        while (k_msgq_get(&mqtt_attempt_q, &attempt, K_NO_WAIT) == 0) {
+            char log_buf[64];  // Adjust size if needed
+            char log_buf2[64];  // Adjust size if needed
+
+            snprintf(log_buf, sizeof(log_buf), "%s: %s, %s",
+                attempt.face_name,
+                attempt.face_validated ? "Face Validated" : "Face Rejected",
+                attempt.pin_validated ? "PIN Validated" : "PIN Invalid"
+            );
+            add_log_entry(log_buf);
+
+            snprintf(log_buf2, sizeof(log_buf2),
+                "Door %s", attempt.open ? "Opened" : "Closed"
+            );
+            add_log_entry(log_buf2);
         }
 
-		lv_timer_handler();
-		k_sleep(K_MSEC(10));
+		sleep_ms = lv_timer_handler();
+        indev_idle();
 	}
     return 0;
     
@@ -1,4 +1,6 @@
+#if defined(CONFIG_WIFI)
 #include <esp32_wifi_connect.h>
+#endif
 #include <zephyr/net/mqtt.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/net_mgmt.h>
@@ -6,11 +8,14 @@
 #include <zephyr/net/net_event.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
 #include <string.h>
-#include <zephyr/sys/printk.h>
+#include <errno.h>
 #include <stdbool.h>
 
+#include "lvgl_display.h"
 #include "mqtt_client.h"
+#include "mqtt_parser.h"
 
 LOG_MODULE_REGISTER(mqtt_sub, LOG_LEVEL_INF);
 
@@ -23,15 +28,58 @@ static struct mqtt_client client;
 static struct sockaddr_storage broker;
 static uint8_t rx_buffer[RX_BUFFER_SIZE];
 static uint8_t tx_buffer[TX_BUFFER_SIZE];
+/*
+ * Publish payloads are streamed through this chunk into the incremental
+ * parser, so their size is bounded by MQTT_PAYLOAD_MAX rather than by any
+ * buffer. Both live here, off the 2 KiB thread stack.
+ */
+static char payload_chunk[MQTT_PAYLOAD_CHUNK_SIZE];
+static struct mqtt_parser payload_parser;
+/* Parse target for the payload being read; copied to mqtt_state only once it is complete */
+static mqtt_lvgl_data_t payload_state;
+#if defined(CONFIG_WIFI)
 static struct k_sem wifi_connected;
+#endif
 
 static bool mqtt_connected = false;
-static bool subscribed = false;
+static bool session_present = false;
+/* The broker address is resolved once and kept until connecting to it keeps failing */
+static bool broker_resolved = false;
+static uint16_t next_message_id = 1;
 
 static struct pollfd fds[1];
 static int nfds;
 
-K_FIFO_DEFINE(mqtt_lvgl_fifo);
+K_MSGQ_DEFINE(mqtt_attempt_q, sizeof(struct mqtt_attempt_event), MQTT_ATTEMPT_QUEUE_LEN, 4);
+
+/*
+ * Latest-state mailbox. The MQTT thread folds each payload into
+ * mqtt_state, copies it to the back slot and flips front under the
+ * lock; the UI copies the front slot out under the same lock. Neither
+ * side ever waits on the other for more than one small copy, and a
+ * burst of publishes just replaces the state the UI has not seen yet.
+ */
+static mqtt_lvgl_data_t mqtt_state = {
+	.locked = true,
+	.face_name = "Unknown",
+	.temperature = "--",
+	.humidity = "--",
+	.air_quality = "Unknown",
+};
+static mqtt_lvgl_data_t mailbox[2];
+static uint8_t mailbox_front;
+static uint32_t mailbox_gen;
+static struct k_spinlock mailbox_lock;
+static uint32_t attempts_dropped;
+
+static struct {
+	uint32_t payloads;
+	uint32_t bytes;
+	uint32_t chunks;
+	uint32_t largest;
+	uint32_t truncated;	/* longer than MQTT_PAYLOAD_MAX, tail discarded */
+} rx_stats;
+static k_tid_t mqtt_thread;
 
 void parse_bracketed_pairs(const char *input, mqtt_lvgl_data_t *data) {
     const char *p = input;
@@ -85,115 +133,96 @@ void parse_bracketed_pairs(const char *input, mqtt_lvgl_data_t *data) {
     }
 }
 
-void parse_bracketed_triples(const char *input, mqtt_lvgl_data_t *data) {
-    const char *p = input;
-    char key[32], value[32];
-
-    float eco2 = -1.0f;
-    float etvoc = -1.0f;
-    bool face_name_received = false;
+static void mailbox_publish(const mqtt_lvgl_data_t *state) {
+	uint8_t back = mailbox_front ^ 1;
 
-    while ((p = strchr(p, '[')) != NULL) {
-        p++;  // move past '['
+	// Only this thread writes, and the UI never reads the back slot
+	mailbox[back] = *state;
 
-        const char *end = strchr(p, ']');
-        if (!end) break;
+	k_spinlock_key_t key = k_spin_lock(&mailbox_lock);
+	mailbox_front = back;
+	mailbox_gen++;
+	k_spin_unlock(&mailbox_lock, key);
 
-        size_t len = end - p;
-        char triple[96];
-        if (len >= sizeof(triple)) len = sizeof(triple) - 1;
-        strncpy(triple, p, len);
-        triple[len] = '\0';
-
-        // Split into parts: device, key, value
-        char *device = strtok(triple, ",");
-        char *k = strtok(NULL, ",");
-        char *v = strtok(NULL, ",");
-
-        if (!device || !k) {
-            p = end + 1;
-            continue;
-        }
-
-        strncpy(key, k, sizeof(key));
-
-        // Assign default or actual value
-        if (v && *v != '\0') {
-            strncpy(value, v, sizeof(value));
-        // } else if (strcmp(key, "person") == 0) {
+	k_event_post(&ui_events, UI_EVENT_MQTT_STATE);
+}
 
-            // strncpy(value, "unknown", sizeof(value));
-        } else {
-            p = end + 1;
-            continue;
-        }
+bool mqtt_lvgl_state_get(mqtt_lvgl_data_t *out, uint32_t *seen_gen) {
+	bool updated = false;
+	k_spinlock_key_t key = k_spin_lock(&mailbox_lock);
 
-        // Only handle fields in mqtt_lvgl_data_t
-        if (strcmp(key, "door_state") == 0) {
-            data->locked = strcmp(value, "locked") == 0;
-            data->open = !data->locked;
-            data->pin_validated = !data->locked;
-        } else if (strcmp(key, "person_present") == 0) {
-            data->motion_detected = (strcmp(value, "1") == 0);
-        } else if (strcmp(key, "attempt") == 0) {
-            data->new_attempt = atoi(value);
-        } else if (strcmp(key, "person") == 0) {
-            strncpy(data->face_name, value, sizeof(data->face_name) - 1);
-            data->face_name[sizeof(data->face_name) - 1] = '\0';
-            face_name_received = true;
-        } else if (strcmp(key, "Temp") == 0) {
-            strncpy(data->temperature, value, sizeof(data->temperature) - 1);
-            data->temperature[sizeof(data->temperature) - 1] = '\0';
-		} else if (strcmp(key, "Hum") == 0) {
-            strncpy(data->humidity, value, sizeof(data->humidity) - 1);
-            data->humidity[sizeof(data->humidity) - 1] = '\0';
-        } else if (strcmp(key, "eCO2") == 0) {
-            eco2 = atof(value);
-        } else if (strcmp(key, "eTVOC") == 0) {
-            etvoc = atof(value);
-        }
+	if (mailbox_gen != *seen_gen) {
+		*out = mailbox[mailbox_front];
+		*seen_gen = mailbox_gen;
+		updated = true;
+	}
 
-        p = end + 1;
-    }
+	k_spin_unlock(&mailbox_lock, key);
+	return updated;
+}
 
-    // Set face validation status
-    if (face_name_received && strcmp(data->face_name, "Unknown") != 0) {
-        data->face_validated = true;
-    } else {
-        data->face_validated = false;
-    }
+/* Hand the state a payload just updated to the UI */
+static void state_commit(void) {
+	if (mqtt_state.new_attempt) {
+		struct mqtt_attempt_event event = {
+			.face_validated = mqtt_state.face_validated,
+			.pin_validated = mqtt_state.pin_validated,
+			.open = mqtt_state.open,
+		};
+
+		strncpy(event.face_name, mqtt_state.face_name, sizeof(event.face_name) - 1);
+		if (k_msgq_put(&mqtt_attempt_q, &event, K_NO_WAIT) != 0) {
+			attempts_dropped++;
+			LOG_WRN("Attempt queue full, %u attempts dropped", attempts_dropped);
+		} else {
+			k_event_post(&ui_events, UI_EVENT_MQTT_ATTEMPT);
+		}
+	}
 
-    // Determine air quality from eCO2 and eTVOC
-    if (eco2 > 0 && etvoc > 0) {
-        if (eco2 < 800 && etvoc < 100)
-            strncpy(data->air_quality, "Good", sizeof(data->air_quality));
-        else if (eco2 < 1200 && etvoc < 300)
-            strncpy(data->air_quality, "Moderate", sizeof(data->air_quality));
-        else
-            strncpy(data->air_quality, "Poor", sizeof(data->air_quality));
-    } else {
-        strncpy(data->air_quality, "Unknown", sizeof(data->air_quality));
-    }
+	mailbox_publish(&mqtt_state);
 }
 
-void send_mqtt_data(char *input) {
-    // if (!data) {
-    //     // handle allocation failure
-    //     return;
-    // }
-	mqtt_lvgl_data_t *data = k_malloc(sizeof(mqtt_lvgl_data_t));
-	if (!data) {
-		LOG_ERR("Failed to allocate memory for MQTT LVGL data");
-		return;
+/**
+ * Read a publish payload of len bytes chunk by chunk into the parser.
+ * Bytes past MQTT_PAYLOAD_MAX are still read, so the stream stays in
+ * step, but not parsed. A read error part way through leaves mqtt_state
+ * untouched. Returns 0 or a negative error.
+ */
+static int receive_payload(size_t len) {
+	size_t received = 0;
+
+	payload_state = mqtt_state;
+	payload_state.new_attempt = false;
+	mqtt_parser_begin(&payload_parser, &payload_state);
+
+	while (received < len) {
+		int rc = mqtt_read_publish_payload_blocking(&client, payload_chunk,
+							    MIN(len - received, sizeof(payload_chunk)));
+		if (rc <= 0) {
+			return rc == 0 ? -EIO : rc;
+		}
+
+		if (received < MQTT_PAYLOAD_MAX) {
+			mqtt_parser_feed(&payload_parser, payload_chunk,
+					 MIN((size_t)rc, MQTT_PAYLOAD_MAX - received));
+		}
+		received += rc;
+		rx_stats.chunks++;
 	}
-	printk("HEREA");
-	parse_bracketed_triples(input, data);
-	printk("HEREB");
 
+	mqtt_parser_end(&payload_parser);
+	mqtt_state = payload_state;
 
-    k_fifo_put(&mqtt_lvgl_fifo, data);
-	printk("HEREC");
+	rx_stats.payloads++;
+	rx_stats.bytes += len;
+	rx_stats.largest = MAX(rx_stats.largest, len);
+	if (len > MQTT_PAYLOAD_MAX) {
+		rx_stats.truncated++;
+		LOG_WRN("Payload of %u bytes, only the first %u parsed", (unsigned int)len, MQTT_PAYLOAD_MAX);
+	}
 
+	state_commit();
+	return 0;
 }
 
 /**
@@ -228,44 +257,47 @@ static void mqtt_evt_handler(struct mqtt_client *const c, const struct mqtt_evt
 
 	case MQTT_EVT_CONNACK:
 		if (evt->result != 0) {
-            LOG_INF("MQTT connect failed %d\n", evt->result);
+            LOG_ERR("MQTT connect failed %d", evt->result);
             break;
         }
-        LOG_INF("MQTT Connected");
+        session_present = evt->param.connack.session_present_flag;
+        LOG_INF("MQTT Connected (session %s)", session_present ? "resumed" : "new");
         mqtt_connected = true;
         break;
 
+	case MQTT_EVT_SUBACK:
+		LOG_INF("Subscription acknowledged (id %u)", evt->param.suback.message_id);
+		break;
+
 	case MQTT_EVT_DISCONNECT:
-		LOG_INF("MQTT disconnected");
-		printk("MQTT client disconnected %d\n", evt->result);
+		LOG_INF("MQTT disconnected (%d)", evt->result);
         mqtt_connected = false;
 		clear_fds();
 		break;
 
 	case MQTT_EVT_PUBLISH: {
 	    const struct mqtt_publish_param *p = &evt->param.publish;
-    	char buf[RX_BUFFER_SIZE];
 
-    	printk("MQTT_EVT_PUBLISH received\n");
-    	printk("Topic: %.*s\n", p->message.topic.topic.size, p->message.topic.topic.utf8);
-    	printk("Payload length: %d\n", p->message.payload.len);
+    	// The topic is not NUL terminated, so it stays out of deferred logging; only MQTT_TOPIC is subscribed
+    	LOG_DBG("Publish id %u, %u-byte payload", p->message_id, p->message.payload.len);
 
     	if (p->message.payload.len > 0) {
-        	int rc = mqtt_read_publish_payload(&client, buf, MIN(p->message.payload.len, sizeof(buf) - 1));
-        		if (rc < 0) {
-            	printk("ERROR: Failed to read publish payload [%d]\n", rc);
+        	int rc = receive_payload(p->message.payload.len);  // Process the payload data
+        	if (rc < 0) {
+            	LOG_ERR("Failed to read publish payload [%d]", rc);
             	break;
         	}
-			
-        	buf[MIN(p->message.payload.len, sizeof(buf) - 1)] = '\0';
-        	// printk("Payload: %s\n", buf);
-			printk("NEW PAYLOAD");
-			send_mqtt_data(buf);  // Process the payload data
 
     	} else {
-        	printk("Payload length is zero.\n");
+        	LOG_DBG("Empty publish payload");
     	}
 
+		// Without the ack the broker redelivers every QoS 1 message
+		if (p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+			const struct mqtt_puback_param ack = { .message_id = p->message_id };
+			mqtt_publish_qos1_ack(&client, &ack);
+		}
+
     	break;
 	}
 	default:
@@ -275,11 +307,14 @@ static void mqtt_evt_handler(struct mqtt_client *const c, const struct mqtt_evt
 }
 
 /**
- * Initialize the MQTT client and set up the broker address.
- * This function resolves the broker address and prepares the MQTT client structure.
- * It also sets the client ID, username, and password if provided.
+ * Resolve the broker address, unless a previous lookup is still cached.
+ * Returns 0 on success or -EHOSTUNREACH if the lookup failed.
  */
-static int mqtt_client_broker_init(void) {
+static int mqtt_resolve_broker(void) {
+
+	if (broker_resolved) {
+		return 0;
+	}
 
 	struct addrinfo hints = {
     	.ai_family = AF_INET,
@@ -290,7 +325,7 @@ static int mqtt_client_broker_init(void) {
 	int err = getaddrinfo(MQTT_BROKER_ADDR, NULL, &hints, &res);
 	if (err != 0 || res == NULL) {
     	LOG_ERR("Failed to resolve broker address");
-    	return -1;
+    	return -EHOSTUNREACH;
 	}
 
 	// Fill broker sockaddr
@@ -299,38 +334,41 @@ static int mqtt_client_broker_init(void) {
 	broker4->sin_port = htons(MQTT_BROKER_PORT);  // Ensure correct port
 	freeaddrinfo(res);  // Free the DNS result
 
-	// Set up MQTT client parameters
-	struct mqtt_utf8 client_id = {
-		.utf8 = (uint8_t *)CLIENT_ID,
-		.size = strlen(CLIENT_ID),
-	};
+	broker_resolved = true;
+	return 0;
+}
 
-	struct mqtt_utf8 username = {
-		.utf8 = (uint8_t *)MQTT_USERNAME,
-		.size = MQTT_USERNAME != NULL ? strlen(MQTT_USERNAME) : 0,  // Handle NULL username
-	};
+/**
+ * Initialize the MQTT client structure.
+ * It sets the client ID, username, and password if provided, and asks for a
+ * persistent session so the broker keeps our subscription across reconnects.
+ */
+static void mqtt_client_broker_init(void) {
 
-	struct mqtt_utf8 password = {
-		.utf8 = (uint8_t *)MQTT_PASSWORD,
-		.size = MQTT_PASSWORD != NULL ? strlen(MQTT_PASSWORD) : 0,  // Handle NULL password
-	};
+	// The client keeps pointers to these, so they must outlive this function
+	static struct mqtt_utf8 username;
+	static struct mqtt_utf8 password;
+
+	username.utf8 = (uint8_t *)MQTT_USERNAME;
+	username.size = MQTT_USERNAME != NULL ? strlen(MQTT_USERNAME) : 0;  // Handle NULL username
+	password.utf8 = (uint8_t *)MQTT_PASSWORD;
+	password.size = MQTT_PASSWORD != NULL ? strlen(MQTT_PASSWORD) : 0;  // Handle NULL password
 
-	memset(&client, 0, sizeof(client));
 	mqtt_client_init(&client);
 
 	client.broker = &broker;
 	client.evt_cb = mqtt_evt_handler;
-	client.client_id = client_id;
-	client.user_name = &username;
-	client.password = &password;
+	client.client_id.utf8 = (uint8_t *)CLIENT_ID;
+	client.client_id.size = strlen(CLIENT_ID);
+	client.user_name = MQTT_USERNAME != NULL ? &username : NULL;
+	client.password = MQTT_PASSWORD != NULL ? &password : NULL;
 	client.protocol_version = MQTT_VERSION_3_1_1;
+	client.clean_session = 0;
 	client.transport.type = MQTT_TRANSPORT_NON_SECURE;
 	client.rx_buf = rx_buffer;
 	client.rx_buf_size = sizeof(rx_buffer);
 	client.tx_buf = tx_buffer;
 	client.tx_buf_size = sizeof(tx_buffer);
-
-	return 0;
 }
 
 /**
@@ -352,7 +390,7 @@ int mqtt_subscribe_to_topic(void) {
 	const struct mqtt_subscription_list sub_list = {
 		.list = &topic,
 		.list_count = 1,
-		.message_id = 1,
+		.message_id = next_message_id++,
 	};
 
 	int rc = mqtt_subscribe(&client, &sub_list);
@@ -365,6 +403,7 @@ int mqtt_subscribe_to_topic(void) {
 	return 0;
 }
 
+#if defined(CONFIG_WIFI)
 /* wifi event callback to set connection semaphore */
 static void wifi_event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt_event, struct net_if *iface) {
 	if (mgmt_event == NET_EVENT_IPV4_ADDR_ADD) {
@@ -372,6 +411,7 @@ static void wifi_event_handler(struct net_mgmt_event_callback *cb, uint32_t mgmt
 		k_sem_give(&wifi_connected);
 	}
 }
+#endif
 
 /**
  * Poll the MQTT socket for incoming data.
@@ -390,7 +430,8 @@ static int poll_mqtt_socket(int timeout)
 
 	rc = zsock_poll(fds, nfds, timeout);
 	if (rc < 0) {
-		LOG_ERR("Socket poll error [%d]", rc);
+		LOG_ERR("Socket poll error [%d]", errno);
+		return -errno;
 	}
 
 	return rc;
@@ -398,97 +439,97 @@ static int poll_mqtt_socket(int timeout)
 
 /**
  * Connect to the MQTT broker.
- * This function initializes the MQTT client and connects to the broker.
- * It blocks until the MQTT connection is established or fails.
+ * This function makes one connection attempt and waits for the CONNACK.
  * Returns 0 on success or an error code on failure.
  */
 int app_mqtt_connect(void)
 {
-	int rc = 0;
+	int rc;
 
 	mqtt_connected = false;
 
-	/* Block until MQTT CONNACK event callback occurs */
-	while (!mqtt_connected) {
-
-		mqtt_client_broker_init();
-		/* Initialize MQTT client */
+	rc = mqtt_resolve_broker();
+	if (rc != 0) {
+		return rc;
+	}
 
-		rc = mqtt_connect(&client);
-		if (rc != 0) {
-			LOG_ERR("MQTT Connect failed [%d]", rc);
-			k_msleep(MSECS_WAIT_RECONNECT);
-			continue;
-		}
+	mqtt_client_broker_init();
 
-		/* Poll MQTT socket for response */
-		rc = poll_mqtt_socket(MSECS_NET_POLL_TIMEOUT);
-		if (rc > 0) {
-			mqtt_input(&client);
-		}
+	rc = mqtt_connect(&client);
+	if (rc != 0) {
+		LOG_ERR("MQTT Connect failed [%d]", rc);
+		return rc;
+	}
 
-		if (!mqtt_connected) {
-			mqtt_abort(&client);
-		}
+	/* Poll MQTT socket for the CONNACK */
+	rc = poll_mqtt_socket(MSECS_NET_POLL_TIMEOUT);
+	if (rc > 0) {
+		mqtt_input(&client);
 	}
 
 	if (!mqtt_connected) {
-		return -EINVAL;
+		mqtt_abort(&client);
+		return -ETIMEDOUT;
 	}
 
 	return 0;
 }
 
 /**
- * Process MQTT events and keep the connection alive.
- * This function checks for incoming MQTT data and processes it.
- * It also handles the MQTT keepalive mechanism.
- * Returns 0 on success or an error code on failure.
+ * Process MQTT events until the connection is lost.
+ * Blocks in zsock_poll until data arrives or the keepalive falls due, so a
+ * publish is handled as soon as it lands. Returns the error that ended it.
  */
 int app_mqtt_process(void)
 {
 	int rc;
 
-	rc = poll_mqtt_socket(mqtt_keepalive_time_left(&client));
-	if (rc != 0) {
-		if (fds[0].revents & ZSOCK_POLLIN) {
-			/* MQTT data received */
-			rc = mqtt_input(&client);
+	while (mqtt_connected) {
+		uint32_t keepalive_ms = mqtt_keepalive_time_left(&client);
 
-			if (mqtt_input(&client) == -EBUSY) {
-    			LOG_WRN("MQTT client busy, skipping input");
-    			return 0;  // Avoid treating it as fatal
-			}	
+		rc = poll_mqtt_socket(MIN(keepalive_ms, INT32_MAX));
+		if (rc < 0) {
+			return rc;
+		}
 
-			if (rc != 0) {
-				LOG_ERR("MQTT Input failed [%d]", rc);
-				return rc;
+		if (rc > 0) {
+			if (fds[0].revents & ZSOCK_POLLIN) {
+				/* MQTT data received */
+				rc = mqtt_input(&client);
+				if (rc != 0) {
+					LOG_ERR("MQTT Input failed [%d]", rc);
+					return rc;
+				}
 			}
 			/* Socket error */
-			if (fds[0].revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR)) {
+			if (fds[0].revents & (ZSOCK_POLLHUP | ZSOCK_POLLERR | ZSOCK_POLLNVAL)) {
 				LOG_ERR("MQTT socket closed / error");
 				return -ENOTCONN;
 			}
 		}
-	} else {
-		/* Socket poll timed out, time to call mqtt_live() */
+
+		/* Sends a ping only once the keepalive is due */
 		rc = mqtt_live(&client);
-		if (rc != 0) {
+		if (rc != 0 && rc != -EAGAIN) {
 			LOG_ERR("MQTT Live failed [%d]", rc);
 			return rc;
 		}
 	}
 
-	return 0;
+	return -ENOTCONN;
 }
 
 /**
  * Main function to initialize the Wi-Fi connection and MQTT client.
- * It waits for the Wi-Fi connection to be established, connects to the MQTT broker,
- * subscribes to a topic, and processes incoming MQTT messages.
+ * It waits for the Wi-Fi connection to be established, then keeps an MQTT
+ * session up for good: connect, subscribe unless the broker kept our
+ * session, process events, and on any failure back off and reconnect.
  */
 int start_mqtt_client(void) {
 
+	mqtt_thread = k_current_get();
+
+#if defined(CONFIG_WIFI)
 	k_sem_init(&wifi_connected, 0, 1);
 
 	static struct net_mgmt_event_callback wifi_cb;
@@ -499,37 +540,72 @@ int start_mqtt_client(void) {
 
 	LOG_INF("Waiting for Wi-Fi...");
 	if (k_sem_take(&wifi_connected, K_SECONDS(15)) != 0) {
-		LOG_ERR("Wi-Fi connection timed out");
-		return -1;
+		LOG_WRN("Wi-Fi connection slow, still waiting");
+		k_sem_take(&wifi_connected, K_FOREVER);
 	}
-	// Retry to connect to Wi-Fi if needed?
+#else
+	// Wired or simulated link: net_config had the address up before threads started
+#endif
 
-	LOG_INF("Connecting to MQTT broker...");
-	if (app_mqtt_connect() != 0) {
-		LOG_ERR("Failed to connect to MQTT");
-		return -1;
-	}
+	uint32_t backoff_ms = MSECS_WAIT_RECONNECT;
+	int failures = 0;
 
-	LOG_INF("Subscribing to MQTT topic...");
-	if (mqtt_subscribe_to_topic() != 0) {
-		LOG_ERR("Failed to subscribe to MQTT topic");
-		return -1;
-	}
-	LOG_INF("Subscribed to topic %s", MQTT_TOPIC);
-	int rc;
+	while (1) {
+		LOG_INF("Connecting to MQTT broker...");
+		int rc = app_mqtt_connect();
 
-	while (mqtt_connected) {
-		rc = app_mqtt_process();
-		if (rc != 0) {
-			break;
+		if (rc == 0 && !session_present) {
+			LOG_INF("Subscribing to MQTT topic...");
+			rc = mqtt_subscribe_to_topic();
+			if (rc != 0) {
+				mqtt_abort(&client);
+			}
+		}
+
+		if (rc == 0) {
+			LOG_INF("Listening on topic %s", MQTT_TOPIC);
+			backoff_ms = MSECS_WAIT_RECONNECT;
+			failures = 0;
+
+			rc = app_mqtt_process();
+			LOG_WRN("MQTT session ended [%d]", rc);
+			if (mqtt_connected) {
+				mqtt_abort(&client);
+			}
+			mqtt_connected = false;
+		} else if (++failures >= MQTT_RESOLVE_AFTER_FAILURES) {
+			// The broker may have moved; look it up again
+			broker_resolved = false;
+			failures = 0;
 		}
-		k_msleep(100);  // Adjust as needed for your application
 
-		// how to publish...
+		LOG_INF("Retrying MQTT in %u ms", backoff_ms);
+		k_msleep(backoff_ms);
+		backoff_ms = MIN(backoff_ms * 2, MSECS_MAX_RECONNECT);
 	}
-	mqtt_disconnect(&client);
 
 	return 0;
 }
 
+static int cmd_mqtt_stats(const struct shell *sh, size_t argc, char **argv) {
+	shell_print(sh, "payloads: %u, %u bytes in %u chunks of up to %u",
+		    rx_stats.payloads, rx_stats.bytes, rx_stats.chunks, MQTT_PAYLOAD_CHUNK_SIZE);
+	shell_print(sh, "largest: %u bytes, %u over the %u byte limit",
+		    rx_stats.largest, rx_stats.truncated, MQTT_PAYLOAD_MAX);
+	shell_print(sh, "attempts dropped: %u", attempts_dropped);
 
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+	size_t unused;
+
+	if (mqtt_thread && k_thread_stack_space_get(mqtt_thread, &unused) == 0) {
+		size_t size = mqtt_thread->stack_info.size;
+
+		shell_print(sh, "stack: %u of %u bytes used at most",
+			    (unsigned int)(size - unused), (unsigned int)size);
+	}
+#endif
+	return 0;
+}
+SHELL_CMD_REGISTER(mqtt_stats, NULL,
+	"MQTT payload reception and thread stack high-water mark",
+	cmd_mqtt_stats);
@@ -0,0 +1,319 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_parser.h"
+
+/* Air quality thresholds, in tenths of ppm / ppb */
+#define ECO2_GOOD_TENTHS        8000
+#define ECO2_MODERATE_TENTHS    12000
+#define ETVOC_GOOD_TENTHS       1000
+#define ETVOC_MODERATE_TENTHS   3000
+
+#define BENCH_DEFAULT_ITERATIONS 1000
+
+enum mqtt_key {
+    KEY_UNKNOWN,
+    KEY_DOOR_STATE,
+    KEY_PERSON_PRESENT,
+    KEY_ATTEMPT,
+    KEY_PERSON,
+    KEY_TEMP,
+    KEY_HUM,
+    KEY_ECO2,
+    KEY_ETVOC,
+};
+
+/* A field of a triple: points into the payload, not NUL terminated */
+struct field {
+    const char *s;
+    size_t len;
+};
+
+static bool field_is(const struct field *f, const char *lit, size_t lit_len) {
+    return f->len == lit_len && memcmp(f->s, lit, lit_len) == 0;
+}
+
+#define FIELD_IS(f, lit) field_is((f), (lit), sizeof(lit) - 1)
+
+/* Every key has a distinct (length, first char), so one switch picks the only candidate */
+static enum mqtt_key lookup_key(const struct field *k) {
+    switch (k->len) {
+    case 3:
+        return FIELD_IS(k, "Hum") ? KEY_HUM : KEY_UNKNOWN;
+    case 4:
+        if (k->s[0] == 'T') {
+            return FIELD_IS(k, "Temp") ? KEY_TEMP : KEY_UNKNOWN;
+        }
+        return FIELD_IS(k, "eCO2") ? KEY_ECO2 : KEY_UNKNOWN;
+    case 5:
+        return FIELD_IS(k, "eTVOC") ? KEY_ETVOC : KEY_UNKNOWN;
+    case 6:
+        return FIELD_IS(k, "person") ? KEY_PERSON : KEY_UNKNOWN;
+    case 7:
+        return FIELD_IS(k, "attempt") ? KEY_ATTEMPT : KEY_UNKNOWN;
+    case 10:
+        return FIELD_IS(k, "door_state") ? KEY_DOOR_STATE : KEY_UNKNOWN;
+    case 14:
+        return FIELD_IS(k, "person_present") ? KEY_PERSON_PRESENT : KEY_UNKNOWN;
+    default:
+        return KEY_UNKNOWN;
+    }
+}
+
+/* Largest integer part whose tenths (with a .9) still fit in an int32_t */
+#define TENTHS_INT_MAX  ((INT32_MAX - 9) / 10)
+
+/* "[-]digits[.digits]" to tenths; further decimals are truncated, out-of-range values rejected */
+static bool parse_tenths(const struct field *v, int32_t *out) {
+    const char *p = v->s;
+    const char *end = v->s + v->len;
+    bool negative = false;
+    int32_t value = 0;
+
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p == end) {
+        return false;
+    }
+
+    for (; p < end && *p != '.'; p++) {
+        if (*p < '0' || *p > '9' || value > (TENTHS_INT_MAX - (*p - '0')) / 10) {
+            return false;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    value *= 10;
+
+    if (p < end && ++p < end) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        value += *p - '0';
+    }
+
+    *out = negative ? -value : value;
+    return true;
+}
+
+static void copy_field(char *dst, size_t size, const struct field *v) {
+    size_t len = MIN(v->len, size - 1);
+
+    memcpy(dst, v->s, len);
+    dst[len] = '\0';
+}
+
+/* One triple, between (not including) its '[' and ']' */
+static void parse_triple(struct mqtt_parser *parser, const char *s, size_t len) {
+    mqtt_lvgl_data_t *data = parser->data;
+    const char *p = s;
+    const char *end = s + len;
+    const char *start = s;
+    struct field fields[3];
+    int32_t num;
+    int n = 0;
+
+    // Split on ','; fields past the third are ignored
+    for (; p < end; p++) {
+        if (*p == ',') {
+            if (n < 3) {
+                fields[n] = (struct field){ start, p - start };
+            }
+            n++;
+            start = p + 1;
+        }
+    }
+    if (n < 3) {
+        fields[n] = (struct field){ start, p - start };
+    }
+    n++;
+
+    if (n < 3 || fields[1].len == 0 || fields[2].len == 0) {
+        return;
+    }
+
+    const struct field *value = &fields[2];
+
+    switch (lookup_key(&fields[1])) {
+    case KEY_DOOR_STATE:
+        data->locked = FIELD_IS(value, "locked");
+        data->open = !data->locked;
+        data->pin_validated = !data->locked;
+        break;
+    case KEY_PERSON_PRESENT:
+        data->motion_detected = FIELD_IS(value, "1");
+        break;
+    case KEY_ATTEMPT:
+        data->new_attempt = parse_tenths(value, &num) && num / 10 != 0;
+        break;
+    case KEY_PERSON:
+        copy_field(data->face_name, sizeof(data->face_name), value);
+        parser->face_name_received = true;
+        break;
+    case KEY_TEMP:
+        copy_field(data->temperature, sizeof(data->temperature), value);
+        break;
+    case KEY_HUM:
+        copy_field(data->humidity, sizeof(data->humidity), value);
+        break;
+    case KEY_ECO2:
+        if (parse_tenths(value, &num)) {
+            parser->eco2 = num;
+            parser->eco2_received = true;
+        }
+        break;
+    case KEY_ETVOC:
+        if (parse_tenths(value, &num)) {
+            parser->etvoc = num;
+            parser->etvoc_received = true;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void carry_append(struct mqtt_parser *parser, const char *s, size_t len) {
+    if (parser->carry_len + len > sizeof(parser->carry)) {
+        parser->carry_overflow = true;
+        return;
+    }
+    memcpy(&parser->carry[parser->carry_len], s, len);
+    parser->carry_len += len;
+}
+
+void mqtt_parser_begin(struct mqtt_parser *parser, mqtt_lvgl_data_t *data) {
+    parser->data = data;
+    parser->carry_len = 0;
+    parser->in_triple = false;
+    parser->carry_overflow = false;
+    parser->eco2 = -1;
+    parser->etvoc = -1;
+    parser->eco2_received = false;
+    parser->etvoc_received = false;
+    parser->face_name_received = false;
+}
+
+void mqtt_parser_feed(struct mqtt_parser *parser, const char *buf, size_t len) {
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *close;
+
+    // Finish the triple the previous chunk cut off
+    if (parser->in_triple) {
+        close = memchr(p, ']', end - p);
+        carry_append(parser, p, (close ? close : end) - p);
+        if (!close) {
+            return;
+        }
+        if (!parser->carry_overflow) {
+            parse_triple(parser, parser->carry, parser->carry_len);
+        }
+        parser->in_triple = false;
+        p = close + 1;
+    }
+
+    while ((p = memchr(p, '[', end - p)) != NULL) {
+        const char *start = ++p;
+
+        close = memchr(start, ']', end - start);
+        if (!close) {
+            // Only a triple cut off by the end of the chunk is copied
+            parser->in_triple = true;
+            parser->carry_len = 0;
+            parser->carry_overflow = false;
+            carry_append(parser, start, end - start);
+            return;
+        }
+        parse_triple(parser, start, close - start);
+        p = close + 1;
+    }
+}
+
+/* A payload without the inputs keeps the previous face_validated / air_quality */
+void mqtt_parser_end(struct mqtt_parser *parser) {
+    mqtt_lvgl_data_t *data = parser->data;
+
+    if (parser->face_name_received) {
+        data->face_validated = strcmp(data->face_name, "Unknown") != 0;
+    }
+
+    if (!parser->eco2_received || !parser->etvoc_received) {
+        return;
+    }
+
+    const char *air = "Unknown";
+    if (parser->eco2 > 0 && parser->etvoc > 0) {
+        if (parser->eco2 < ECO2_GOOD_TENTHS && parser->etvoc < ETVOC_GOOD_TENTHS) {
+            air = "Good";
+        } else if (parser->eco2 < ECO2_MODERATE_TENTHS && parser->etvoc < ETVOC_MODERATE_TENTHS) {
+            air = "Moderate";
+        } else {
+            air = "Poor";
+        }
+    }
+    strncpy(data->air_quality, air, sizeof(data->air_quality));
+}
+
+void mqtt_parse_triples(const char *buf, size_t len, mqtt_lvgl_data_t *data) {
+    struct mqtt_parser parser;
+
+    mqtt_parser_begin(&parser, data);
+    mqtt_parser_feed(&parser, buf, len);
+    mqtt_parser_end(&parser);
+}
+
+/* Payloads as published by auth/gui/mqtt_tab.py */
+static const char *const bench_payloads[] = {
+    "[base_sensor,Temp,23.41],[base_sensor,Hum,45.2],[base_sensor,Press,101.3],"
+    "[base_sensor,SensorTemp,23.9],[base_sensor,eCO2,412.0],[base_sensor,eTVOC,12.0],"
+    "[base_sensor,RSSI,-61.0]",
+    "[base_door,door_state,locked],[base_door,ultrasonic,142],[base_door,magnetometer,2710],"
+    "[camera,person_present,1],[camera,person,Alice],[camera,attempt,1]",
+    "[base_sensor,Temp,24.02],[base_sensor,Hum,44.8],[base_sensor,Press,101.2],"
+    "[base_sensor,SensorTemp,24.5],[base_sensor,eCO2,1310.0],[base_sensor,eTVOC,350.0],"
+    "[base_sensor,RSSI,-58.0],[base_door,door_state,unlocked],[base_door,ultrasonic,37],"
+    "[base_door,magnetometer,1190],[camera,person_present,0],[camera,person,]",
+};
+
+static int cmd_mqtt_bench(const struct shell *sh, size_t argc, char **argv) {
+    static struct mqtt_parser bench_parser;
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    int chunk_arg = argc > 2 ? atoi(argv[2]) : INT_MAX;
+    if (iterations <= 0 || chunk_arg <= 0) {
+        shell_error(sh, "Usage: mqtt_bench [iterations] [chunk]");
+        return -EINVAL;
+    }
+    size_t chunk = chunk_arg;
+
+    for (size_t i = 0; i < ARRAY_SIZE(bench_payloads); i++) {
+        const char *payload = bench_payloads[i];
+        size_t len = strlen(payload);
+        mqtt_lvgl_data_t data = { .air_quality = "Unknown" };
+
+        uint32_t start = k_cycle_get_32();
+        for (int n = 0; n < iterations; n++) {
+            mqtt_parser_begin(&bench_parser, &data);
+            for (size_t off = 0; off < len; off += chunk) {
+                mqtt_parser_feed(&bench_parser, &payload[off], MIN(chunk, len - off));
+            }
+            mqtt_parser_end(&bench_parser);
+        }
+        uint32_t cycles = (k_cycle_get_32() - start) / iterations;
+
+        shell_print(sh, "payload %u: %u bytes in %u byte chunks, %u cycles (%u us), air %s",
+                    (unsigned int)i, (unsigned int)len, (unsigned int)MIN(chunk, len),
+                    cycles, k_cyc_to_us_floor32(cycles), data.air_quality);
+    }
+    return 0;
+}
+SHELL_CMD_REGISTER(mqtt_bench, NULL,
+    "Cycles per payload for the MQTT payload parser, fed whole or in chunks: "
+    "mqtt_bench [iterations] [chunk]",
+    cmd_mqtt_bench);
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# Run the admin node's MQTT client on native_sim against a local mosquitto
+# and check that it connects, survives a broker restart with backoff and
+# resumes its persistent session without resubscribing.
+#
+# Needs west, mosquitto and mosquitto_pub on the host, and the TAP
+# interface from Zephyr's net-tools (run "net-setup.sh" there first, as
+# root) so the host is reachable at 192.0.2.2 (boards/native_sim.conf).
+# The display is a dummy one (boards/native_sim.overlay), so no SDL2.
+
+app_dir="$(cd "$(dirname "$0")" && pwd)"
+build_dir="$app_dir/build_native_sim"
+work_dir="$(mktemp -d)"
+log="$work_dir/zephyr.log"
+broker_log="$work_dir/mosquitto.log"
+topic="topic/test/esp32_sub"
+
+cleanup() {
+    kill "$zephyr_pid" "$broker_pid" 2>/dev/null
+    wait 2>/dev/null
+}
+trap cleanup EXIT
+
+start_broker() {
+    mosquitto -v -c "$work_dir/mosquitto.conf" >> "$broker_log" 2>&1 &
+    broker_pid=$!
+}
+
+# Wait up to $2 seconds for $1 to show up $3 times in log file $4 (the node's by default)
+wait_for() {
+    for _ in $(seq "$2"); do
+        if [ "$(grep -c "$1" "${4:-$log}")" -ge "${3:-1}" ]; then
+            return 0
+        fi
+        sleep 1
+    done
+    echo "FAIL: no \"$1\" (x${3:-1}) within $2 s"
+    exit 1
+}
+
+for tool in west mosquitto mosquitto_pub; do
+    if ! command -v "$tool" > /dev/null; then
+        echo "FAIL: $tool not found"
+        exit 1
+    fi
+done
+
+echo "Building for native_sim..."
+if ! west build -p -b native_sim -d "$build_dir" "$app_dir"; then
+    echo "Build failed"
+    exit 1
+fi
+
+# Persistence keeps the node's session (and its subscription) across the restart
+cat > "$work_dir/mosquitto.conf" <<EOF
+listener 1883 192.0.2.2
+allow_anonymous true
+persistence true
+persistence_location $work_dir/
+EOF
+
+start_broker
+"$build_dir/zephyr/zephyr.exe" > "$log" 2>&1 &
+zephyr_pid=$!
+
+wait_for "MQTT Connected (session new)" 30
+wait_for "Listening on topic" 10
+# Every QoS 1 delivery has to be acknowledged, or the broker keeps redelivering it
+mosquitto_pub -h 192.0.2.2 -q 1 -t "$topic" -m "[door,door_state,1],[air,eCO2,412.5],[air,eTVOC,3]"
+wait_for "Received PUBACK from esp32_sub" 10 1 "$broker_log"
+
+echo "Restarting the broker..."
+kill "$broker_pid"
+wait "$broker_pid" 2>/dev/null
+wait_for "Retrying MQTT in" 30
+start_broker
+
+wait_for "MQTT Connected (session resumed)" 90
+if [ "$(grep -c "Subscribing to MQTT topic" "$log")" -ne 1 ]; then
+    echo "FAIL: resubscribed although the session was resumed"
+    exit 1
+fi
+# Still subscribed through the resumed session
+mosquitto_pub -h 192.0.2.2 -q 1 -t "$topic" -m "[door,door_state,0]"
+wait_for "Received PUBACK from esp32_sub" 10 2 "$broker_log"
+
+echo "PASS"
+grep "Retrying MQTT in" "$log"
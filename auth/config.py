@@ -38,9 +38,12 @@ RESOLUTIONS = [
 
 # -----------------------------------------------------------------------------
 # Serial-port settings
-SERIAL_LABELS   = ["base_sensor", "base_door", "other"]
+SERIAL_LABELS   = ["base_sensor", "base_door", "base_door_link", "other"]
 BAUD_RATE       = 115200
 SERIAL_TIMEOUT  = 0.1
+# Base node built with host_link.conf: binary records and lock commands, no shell
+HOST_LINK_LABEL     = "base_door_link"
+HOST_LINK_BAUD_RATE = 1000000
 
 # -----------------------------------------------------------------------------
 # Door-unlock PIN
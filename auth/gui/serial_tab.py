@@ -11,11 +11,12 @@ import re
 import config
 from serial_manager import SerialManager
 from sensor_store import store
+from telemetry_decoder import encode_lock_command
 
 # Regex to strip ANSI escape sequences
 ANSI_ESCAPE = re.compile(r'\x1B\[[0-?]*[ -/]*[@-~]')
-# Regex to catch "pin: 12345" anywhere
-PIN_REGEX = re.compile(r'pin:\s*(\d+)', re.IGNORECASE)
+# Regex to catch "pin: 12345" (optionally "door 1 pin: 12345") anywhere
+PIN_REGEX = re.compile(r'(?:door\s+(\d+)\s+)?pin:\s*(\d+)', re.IGNORECASE)
 
 class SerialTab(ttk.Frame):
     POLL_INTERVAL_MS = 1000
@@ -33,8 +34,9 @@ class SerialTab(ttk.Frame):
         self.sensor_polling = False
         self.door_polling   = False
 
-        # Serial manager invokes _enqueue_message on each incoming line
-        self.manager = SerialManager(self._enqueue_message)
+        # Serial manager invokes _enqueue_message on each incoming line,
+        # _enqueue_record on each host link record
+        self.manager = SerialManager(self._enqueue_message, self._enqueue_record)
 
         self._build_ui()
         self._refresh_available_ports()
@@ -200,6 +202,41 @@ class SerialTab(ttk.Frame):
         # 4) parse/store/trigger door logic
         self._parse_message(label, clean)
 
+    def _enqueue_record(self, label, record):
+        fields = ' '.join(f"{k}={v}" for k, v in record.items() if k != 'uptime_ms')
+        self._enqueue_message(label, f"record {fields}")
+        self._parse_record(label, record)
+
+    def _parse_record(self, label, record):
+        # --- Base node host link: decoded telemetry records ---
+        door = str(record['door'])
+        if 'pin' in record:
+            self._check_pin(label, door, record['pin'])
+        if 'ultrasonic' in record:
+            store.add(label, 'ultrasonic', float(record['ultrasonic']))
+        if 'magnetometer' in record:
+            store.add(label, 'magnetometer', float(record['magnetometer']))
+        if 'locked' in record:
+            store.add(label, 'door_state', 'locked' if record['locked'] else 'unlocked')
+
+    def _check_pin(self, label, door, pin):
+        cur = store.get_current().get('camera', {})
+        known = cur.get('person_present',0)==1 and cur.get('person','')!='Unknown'
+        if known and pin == config.CORRECT_PIN:
+            self._send_lock(label, door, False)
+            self.after(5000, lambda: self._send_lock(label, door, True))
+        elif known:
+            self._log(f"[{label}] ❌ Invalid PIN {pin}")
+
+    def _send_lock(self, label, door='0', locked=True):
+        action = 'lock' if locked else 'unlock'
+        self._log(f"[{label}] ▶ door {door} {action}")
+        if label == config.HOST_LINK_LABEL:
+            # No shell on the host link: send the framed lock command
+            self.manager.send_bytes(label, encode_lock_command(int(door), locked))
+        else:
+            self.manager.send(label, f'door {door} {action}')
+
     def _parse_message(self, label, line):
         # --- Sensor node parsing ---
         if label == 'base_sensor':
@@ -231,15 +268,7 @@ class SerialTab(ttk.Frame):
             # pin anywhere in line?
             m = PIN_REGEX.search(line)
             if m:
-                pin = m.group(1)
-                cur = store.get_current().get('camera', {})
-                known = cur.get('person_present',0)==1 and cur.get('person','')!='Unknown'
-                if known and pin == config.CORRECT_PIN:
-                    self._log("[base_door] ▶ door unlock")
-                    self.manager.send('base_door', 'door unlock')
-                    self.after(5000, self._auto_lock)
-                elif known:
-                    self._log(f"[base_door] ❌ Invalid PIN {pin}")
+                self._check_pin(label, m.group(1) or '0', m.group(2))
                 return
             # ultrasonic
             if line.startswith('ultrasonic:'):
@@ -260,10 +289,6 @@ class SerialTab(ttk.Frame):
                 state = line.split('Door is',1)[1].strip()
                 store.add(label, 'door_state', state)
 
-    def _auto_lock(self):
-        self._log("[base_door] ▶ door lock")
-        self.manager.send('base_door', 'door lock')
-
     def _flush_messages(self):
         chunk = []
         while not self._msg_queue.empty():
@@ -4,15 +4,23 @@ import serial, threading, time
 from serial.tools import list_ports
 from config import SERIAL_LABELS, BAUD_RATE, SERIAL_TIMEOUT
 import config
+from telemetry_decoder import TelemetryStream
 
 class SerialDevice:
-    def __init__(self, port: str, label: str, on_receive):
+    def __init__(self, port: str, label: str, on_receive, on_record=None):
         self.port   = port
         self.label  = label
-        self.ser    = serial.Serial(port, BAUD_RATE, timeout=SERIAL_TIMEOUT)
+        self.host_link = label == config.HOST_LINK_LABEL
+        if self.host_link:
+            self.ser = serial.Serial(port, config.HOST_LINK_BAUD_RATE,
+                                     timeout=SERIAL_TIMEOUT, rtscts=True)
+        else:
+            self.ser = serial.Serial(port, BAUD_RATE, timeout=SERIAL_TIMEOUT)
         self.on_receive = on_receive
+        self.on_record  = on_record
         self._running = True
-        threading.Thread(target=self._read_loop, daemon=True).start()
+        loop = self._link_loop if self.host_link else self._read_loop
+        threading.Thread(target=loop, daemon=True).start()
 
     def _read_loop(self):
         while self._running and self.ser.is_open:
@@ -24,18 +32,37 @@ class SerialDevice:
                 pass
             time.sleep(0.05)
 
+    def _link_loop(self):
+        # Host link (base_node/include/hostLink.h): COBS/CRC telemetry records in
+        stream = TelemetryStream()
+        while self._running and self.ser.is_open:
+            try:
+                for kind, item in stream.feed(self.ser.read(256)):
+                    if kind == 'record':
+                        if self.on_record:
+                            self.on_record(self.label, item)
+                    else:
+                        self.on_receive(self.label, item)
+            except Exception:
+                pass
+
     def send(self, msg: str):
         if self.ser.is_open:
             self.ser.write((msg + '\r\n').encode())
 
+    def send_bytes(self, data: bytes):
+        if self.ser.is_open:
+            self.ser.write(data)
+
     def close(self):
         self._running = False
         time.sleep(0.1)
         self.ser.close()
 
 class SerialManager:
-    def __init__(self, on_receive):
+    def __init__(self, on_receive, on_record=None):
         self.on_receive = on_receive
+        self.on_record  = on_record
         self.devices = {}  # label -> SerialDevice
 
     @staticmethod
@@ -49,7 +76,7 @@ class SerialManager:
     def connect(self, port: str, label: str):
         if label in self.devices:
             raise ValueError(f"{label} already connected")
-        self.devices[label] = SerialDevice(port, label, self.on_receive)
+        self.devices[label] = SerialDevice(port, label, self.on_receive, self.on_record)
 
     def send(self, label: str, msg: str):
         if label in self.devices:
@@ -57,6 +84,12 @@ class SerialManager:
         else:
             raise KeyError(f"No device labeled {label}")
 
+    def send_bytes(self, label: str, data: bytes):
+        if label in self.devices:
+            self.devices[label].send_bytes(data)
+        else:
+            raise KeyError(f"No device labeled {label}")
+
     def disconnect(self, label: str):
         if label in self.devices:
             self.devices[label].close()
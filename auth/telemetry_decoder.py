@@ -0,0 +1,169 @@
+# esp32_auth/telemetry_decoder.py
+#
+# Decoder for the base node's binary telemetry stream (see
+# base_node/include/telemetry.h). Records are COBS encoded and end in
+# 0x00; anything that fails COBS or CRC decoding is treated as shell
+# text, so the same decoder works on a dedicated UART or on the console.
+
+import binascii
+import struct
+import sys
+
+PROTOCOL_VERSION = 1
+HEADER = struct.Struct('<BI')   # door, uptime ms
+
+MSG_TYPES = {
+    0x01: 'pin',
+    0x02: 'proximity',
+    0x03: 'door_open',
+    0x05: 'locked',
+    0x10: 'ultrasonic',
+    0x11: 'magnetometer',
+}
+
+
+def cobs_decode(data: bytes):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_encode(data: bytes) -> bytes:
+    out = bytearray([0])
+    code_pos, code = 0, 1
+    for byte in data:
+        if byte:
+            out.append(byte)
+            code += 1
+        if not byte or code == 0xFF:
+            out[code_pos] = code
+            code_pos, code = len(out), 1
+            out.append(0)
+    out[code_pos] = code
+    return bytes(out)
+
+
+def crc16(data: bytes) -> int:
+    # CRC-16/CCITT-FALSE, as crc16_itu_t(0xffff, ...) on the node
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+def parse_tlv(frame: bytes):
+    if not frame or frame[0] != PROTOCOL_VERSION:
+        return None
+    fields = {}
+    pos = 1
+    while pos + 2 <= len(frame):
+        rtype, rlen = frame[pos], frame[pos + 1]
+        value = frame[pos + 2:pos + 2 + rlen]
+        if len(value) != rlen:
+            return None
+        pos += 2 + rlen
+
+        name = MSG_TYPES.get(rtype)
+        if name is None:
+            continue
+        if name == 'pin':
+            fields[name] = value.decode(errors='replace')
+        elif rlen == 2:
+            fields[name] = struct.unpack('<h', value)[0]
+        elif rlen == 1:
+            fields[name] = value[0]
+    return fields
+
+
+def decode_record(chunk: bytes):
+    """Return a record dict, or None if chunk is not a valid telemetry record."""
+    raw = cobs_decode(chunk)
+    if raw is None or len(raw) < HEADER.size + 1 + 2:
+        return None
+    body, crc = raw[:-2], struct.unpack('<H', raw[-2:])[0]
+    if crc16(body) != crc:
+        return None
+    door, uptime_ms = HEADER.unpack_from(body)
+    fields = parse_tlv(body[HEADER.size:])
+    if fields is None:
+        return None
+    return {'door': door, 'uptime_ms': uptime_ms, **fields}
+
+
+def encode_lock_command(door: int, locked: bool) -> bytes:
+    """Lock command for the base node's host link (base_node/include/hostLink.h)."""
+    body = bytes([door, PROTOCOL_VERSION, 0x05, 1, int(locked)])
+    body += struct.pack('<H', crc16(body))
+    return cobs_encode(body) + b'\x00'
+
+
+def _is_text(line: bytes) -> bool:
+    # Shell output: printable ASCII/UTF-8, tabs, CR and ANSI escapes
+    return all(c >= 0x20 or c in (0x09, 0x0D, 0x1B) for c in line)
+
+
+def _text(line: bytes) -> str:
+    return line.decode(errors='ignore').rstrip('\r')
+
+
+class TelemetryStream:
+    """Feed raw serial bytes; get back ('record', dict) and ('text', str) items."""
+
+    def __init__(self):
+        self._pending = bytearray()
+        self.crc_errors = 0
+
+    def feed(self, data: bytes):
+        self._pending += data
+        items = []
+        while True:
+            end = self._pending.find(b'\x00')
+            if end < 0:
+                break
+            chunk = bytes(self._pending[:end])
+            del self._pending[:end + 1]
+            items.extend(self._split(chunk))
+
+        # Complete shell lines can go out now; a half-received record is never all printable
+        while True:
+            end = self._pending.find(b'\n')
+            if end < 0 or not _is_text(self._pending[:end]):
+                break
+            line = bytes(self._pending[:end])
+            del self._pending[:end + 1]
+            if line.strip():
+                items.append(('text', _text(line)))
+        return items
+
+    def _split(self, chunk: bytes):
+        # Shell text may precede a record on a shared UART; the CRC picks out where it starts
+        for start in range(len(chunk)):
+            record = decode_record(chunk[start:])
+            if record is not None:
+                lines = chunk[:start].split(b'\n')
+                return [('text', _text(l)) for l in lines if l.strip()] + [('record', record)]
+
+        if not _is_text(chunk):
+            self.crc_errors += 1
+            return []
+        return [('text', _text(l)) for l in chunk.split(b'\n') if l.strip()]
+
+
+def main():
+    import serial  # pyserial, only needed when run as a script
+    port = sys.argv[1] if len(sys.argv) > 1 else '/dev/ttyACM0'
+    baud = int(sys.argv[2]) if len(sys.argv) > 2 else 115200
+    stream = TelemetryStream()
+    with serial.Serial(port, baud, timeout=0.1) as ser:
+        while True:
+            for kind, item in stream.feed(ser.read(256)):
+                print(item if kind == 'record' else f'# {item}')
+
+
+if __name__ == '__main__':
+    main()
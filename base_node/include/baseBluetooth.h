@@ -1,6 +1,18 @@
 #ifndef BASEBLUETOOTH_H
 #define BASEBLUETOOTH_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+struct door_state;
+
 void bluetooth_receiver0(void);
 
+/* Copy of door id's record; false when no door is bonded to that id */
+bool door_get(uint8_t id, struct door_state *out);
+/* Drive a bonded door's servo: -ENOENT if none, -EALREADY if already in that state */
+int door_set_locked(uint8_t id, bool locked);
+/* Free a disconnected door's id for the next door that bonds; -EBUSY while connected */
+int door_forget(uint8_t id);
+
 #endif // BASEBLUETOOTH_H
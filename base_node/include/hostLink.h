@@ -0,0 +1,66 @@
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <zephyr/devicetree.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Host link: a UART of its own, chosen as `slarm,host-uart`, driven
+ * through the async (DMA) UART API instead of the console's
+ * interrupt-per-byte path.
+ *
+ * RX lands in a small pool of DMA blocks. Frames are COBS encoded and
+ * 0x00-delimited like telemetry records; a frame that sits inside one
+ * block is handed to the host link thread in place (the block is
+ * reference counted until the thread is done with it), and only a frame
+ * straddling two blocks is copied. Inbound frames are
+ *
+ *   door u8 | msgProtocol frame | CRC-16/CCITT-FALSE u16 LE
+ *
+ * and currently carry MSG_TYPE_LOCK_STATE commands.
+ *
+ * TX is double buffered: writers append to one buffer while DMA drains
+ * the other, so telemetry never waits on the wire.
+ *
+ * Build with host_link.conf and host_link.overlay to move the shell and
+ * logs to RTT and give uart0 to the host link at 1 Mbaud.
+ */
+#if DT_HAS_CHOSEN(slarm_host_uart) && defined(CONFIG_UART_ASYNC_API)
+#define HOST_LINK_ENABLED       1
+#else
+#define HOST_LINK_ENABLED       0
+#endif
+
+#define HOST_LINK_RX_BUF_SIZE   256
+#define HOST_LINK_RX_BUF_COUNT  4
+#define HOST_LINK_TX_BUF_SIZE   1024
+#define HOST_LINK_FRAME_MAX     HOST_LINK_RX_BUF_SIZE
+#define HOST_LINK_RX_QUEUE_LEN  8
+/* RX idle time before a partly filled block is reported, in us */
+#define HOST_LINK_RX_TIMEOUT_US 1000
+
+struct host_link_stats {
+    uint32_t baudrate;
+    uint32_t rx_bytes;
+    uint32_t rx_frames;
+    uint32_t rx_copied;     /* frames that straddled two DMA blocks */
+    uint32_t rx_errors;     /* bad COBS, CRC or command */
+    uint32_t rx_dropped;    /* frame too long or hand-off queue full */
+    uint32_t rx_stalls;     /* no free DMA block when the UART asked for one */
+    uint32_t tx_bytes;
+    uint32_t tx_frames;
+    uint32_t tx_dropped;    /* both TX buffers full */
+    uint32_t commands;
+};
+
+/*
+ * Queue already framed bytes for transmission; -ENOMEM if they do not
+ * fit, -EAGAIN until host_link_receiver() has set up the UART.
+ */
+int host_link_write(const uint8_t *data, size_t len);
+void host_link_get_stats(struct host_link_stats *stats);
+/* Receiver thread: starts RX and dispatches inbound frames */
+void host_link_receiver(void);
+
+#endif // HOST_LINK_H
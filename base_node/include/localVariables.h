@@ -2,10 +2,38 @@
 #define LOCAL_VARIABLES_H
 
 #include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/sys/util.h>
 #include <stdbool.h>
+#include "servo.h"
 
-extern volatile int latest_distance_cm;
-extern volatile int latest_avg_value;
-extern volatile bool door_locked;
+/*
+ * Door records, keyed by the door node's bonded identity address. The
+ * record index is the door id: it picks the servo, the history and the
+ * telemetry door byte, so it never depends on connection order. A door
+ * gets the first free record when it first bonds, and the assignment is
+ * kept in settings across reboots. Every door needs a servo, so there
+ * are no more records than servos.
+ *
+ * Records are shared by the BT receiver, shell and host link threads;
+ * hold doors_lock while touching them.
+ */
+#define MAX_DOORS MIN(CONFIG_BT_MAX_CONN, SERVO_COUNT)
+
+struct door_state {
+    bool assigned;
+    bt_addr_le_t addr;
+    bool connected;
+    int latest_distance_cm;
+    int latest_avg_value;
+    bool door_locked;
+    uint32_t frames;
+    uint32_t events;
+    uint32_t servo_errors;
+};
+
+extern struct door_state doors[MAX_DOORS];
+extern struct k_mutex doors_lock;
+extern volatile uint32_t rx_handoff_max_us;
 
 #endif // LOCAL_VARIABLES_H
@@ -1,4 +1,13 @@
 #ifndef SERVO_H
 #define SERVO_H
-int set_servo_locked(bool locked);
-#endif // SERVO_H
\ No newline at end of file
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Servo aliases pwm-servo, pwm-servo1 .. pwm-servo3 */
+#define SERVO_COUNT 4
+
+/* Returns 0, or -ENODEV if the door has no servo in the devicetree */
+int set_servo_locked(uint8_t door, bool locked);
+
+#endif // SERVO_H
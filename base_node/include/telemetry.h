@@ -0,0 +1,47 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Binary telemetry stream for the host.
+ *
+ * Every door frame the base node handles (and every lock change it
+ * makes itself) is pushed as one record:
+ *
+ *   +------+-----------+------------------------------+--------+
+ *   | door | uptime ms | msgProtocol frame (TLV)      | CRC16  |
+ *   |  u8  |  u32 LE   | version, type/len/value ...  | u16 LE |
+ *   +------+-----------+------------------------------+--------+
+ *
+ * The CRC is CRC-16/CCITT-FALSE over everything before it. The record
+ * is COBS encoded and terminated by a 0x00 byte, so a receiver can
+ * resynchronise on any delimiter.
+ *
+ * Records go out over the DMA host link when it is built in (see
+ * hostLink.h), else to the UART chosen as `slarm,telemetry-uart` when
+ * the board has one, streaming from boot in both cases. Otherwise they share the console
+ * UART with the shell and start disabled; shell text never contains
+ * 0x00 and fails the CRC, so the host can tell the two apart.
+ *
+ * Without the host link, records are queued and written out by
+ * telemetry_sender(), so publishers never wait on the UART.
+ */
+#define TELEMETRY_MAX_PAYLOAD   244
+#define TELEMETRY_HEADER_LEN    5
+#define TELEMETRY_CRC_LEN       2
+
+void telemetry_publish(uint8_t door, const uint8_t *frame, uint16_t len);
+/* Push a base-originated lock change (shell or proximity) */
+void telemetry_publish_lock(uint8_t door, bool locked);
+void telemetry_set_enabled(bool enabled);
+bool telemetry_is_enabled(void);
+bool telemetry_has_dedicated_uart(void);
+uint32_t telemetry_records_sent(void);
+/* Records lost because the UART queue was full */
+uint32_t telemetry_records_dropped(void);
+/* Thread entry that drains queued records to the UART; not used with the host link */
+void telemetry_sender(void);
+
+#endif // TELEMETRY_H
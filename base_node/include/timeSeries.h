@@ -0,0 +1,47 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Per-door sensor history kept in RAM at three resolutions. Every sample
+ * lands in the raw ring and in the open 1 min and 15 min buckets; a
+ * bucket is pushed onto its ring once a sample arrives for a later
+ * period. Periods without samples simply leave no entry.
+ */
+#define TS_RAW_LEN      16
+#define TS_1M_LEN       30      /* half an hour */
+#define TS_15M_LEN      24      /* six hours */
+
+enum ts_metric {
+    TS_METRIC_DISTANCE,         /* ultrasonic, cm */
+    TS_METRIC_MAGNETOMETER,     /* average field, centigauss */
+    TS_METRIC_COUNT,
+};
+
+enum ts_resolution {
+    TS_RES_RAW,
+    TS_RES_1M,
+    TS_RES_15M,
+    TS_RES_COUNT,
+};
+
+struct ts_point {
+    uint32_t start_s;   /* uptime at the start of the period (raw: sample time) */
+    int16_t min;
+    int16_t max;
+    int32_t sum;
+    uint16_t count;
+};
+
+void ts_record(uint8_t door, enum ts_metric metric, int16_t value);
+/*
+ * Copy up to max_points of the newest points, oldest first, including
+ * the bucket still being filled. Returns the number copied.
+ */
+size_t ts_read(uint8_t door, enum ts_metric metric, enum ts_resolution res,
+               struct ts_point *points, size_t max_points);
+void ts_clear(uint8_t door);
+
+#endif // TIMESERIES_H
@@ -1,54 +1,336 @@
 #include <zephyr/kernel.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/bluetooth/addr.h>
 #include <zephyr/sys/time_units.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/logging/log_backend.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "CLIshell.h"
+#include "baseBluetooth.h"
 #include "localVariables.h"
-#include "servo.h"
+#include "msgProtocol.h"
+#include "rxBluetooth.h"
+#include "timeSeries.h"
+#include "telemetry.h"
+#include "hostLink.h"
+
+#define BENCH_DEFAULT_ITERATIONS 1000
+
+/* Door id from argv, or door 0 when the command was given without one */
+static int parse_door_id(const struct shell *shell, size_t argc, char **argv, size_t id_argc) {
+    if (argc < id_argc) {
+        return 0;
+    }
+
+    char *end;
+    long id = strtol(argv[1], &end, 10);
+    if (*end != '\0' || id < 0 || id >= MAX_DOORS) {
+        shell_error(shell, "Unknown door: %s (0-%d)", argv[1], MAX_DOORS - 1);
+        return -EINVAL;
+    }
+    return (int)id;
+}
 
 static int read_sensor_data(const struct shell *shell, size_t argc, char **argv) {
-    shell_print(shell, "ultrasonic: %d", latest_distance_cm);
-    shell_print(shell, "magnetometer: %d", latest_avg_value);
-    if (door_locked) {
+    int id = parse_door_id(shell, argc, argv, 2);
+    if (id < 0) {
+        return id;
+    }
+
+    struct door_state copy;
+    const struct door_state *state = &copy;
+
+    if (!door_get(id, &copy)) {
+        shell_print(shell, "door: %d (no door bonded)", id);
+        return 0;
+    }
+
+    char addr[BT_ADDR_LE_STR_LEN];
+    bt_addr_le_to_str(&state->addr, addr, sizeof(addr));
+    shell_print(shell, "door: %d %s (%s)", id, addr, state->connected ? "connected" : "not connected");
+    shell_print(shell, "ultrasonic: %d", state->latest_distance_cm);
+    shell_print(shell, "magnetometer: %d", state->latest_avg_value);
+    if (state->door_locked) {
         shell_print(shell, "Door is locked");
     } else {
         shell_print(shell, "Door is unlocked");
     }
+    shell_print(shell, "servo errors: %u", state->servo_errors);
+    shell_print(shell, "rx dropped: %u, max hand-off: %u us",
+                get_rx_dropped_count(), rx_handoff_max_us);
     return 0;
 }
 static int door(const struct shell *shell, size_t argc, char **argv) {
-    if (argc != 2) {
-        shell_error(shell, "Usage: door <lock|unlock>");
+    if (argc != 2 && argc != 3) {
+        shell_error(shell, "Usage: door [id] <lock|unlock|forget>");
         return -EINVAL;
     }
 
-    if (strcmp(argv[1], "lock") == 0) {
-        if (door_locked) {
-            shell_print(shell, "Door is already locked");
-        } else {
-            set_servo_locked(true);
-            door_locked = true;
-            shell_print(shell, "Door is now locked");
+    int id = parse_door_id(shell, argc, argv, 3);
+    if (id < 0) {
+        return id;
+    }
+
+    const char *action = argv[argc - 1];
+    bool locked;
+
+    if (strcmp(action, "lock") == 0) {
+        locked = true;
+    } else if (strcmp(action, "unlock") == 0) {
+        locked = false;
+    } else if (strcmp(action, "forget") == 0) {
+        int err = door_forget(id);
+        if (err) {
+            shell_error(shell, "Door %d is connected; disconnect it first", id);
+            return err;
         }
-    } else if (strcmp(argv[1], "unlock") == 0) {
-        if (!door_locked) {
-            shell_print(shell, "Door is already unlocked");
-        } else {
-            set_servo_locked(false);
-            door_locked = false;
-            shell_print(shell, "Door is now unlocked");
+        shell_print(shell, "Door %d forgotten; the next door to bond takes its place", id);
+        return 0;
+    } else {
+        shell_error(shell, "Unknown command: %s", action);
+        return -EINVAL;
+    }
+
+    int err = door_set_locked(id, locked);
+    if (err == -EALREADY) {
+        shell_print(shell, "Door %d is already %s", id, locked ? "locked" : "unlocked");
+    } else if (err == -ENOENT) {
+        shell_error(shell, "No door bonded as %d", id);
+        return err;
+    } else if (err) {
+        shell_error(shell, "Door %d servo failed (err %d)", id, err);
+        return err;
+    } else {
+        shell_print(shell, "Door %d is now %s", id, locked ? "locked" : "unlocked");
+    }
+    return 0;
+
+}
+
+/*
+ * Per-door traffic and the aggregate event rate since the last call,
+ * to see how the single receiver thread keeps up as doors are added.
+ */
+static int door_list(const struct shell *shell, size_t argc, char **argv) {
+    static uint32_t last_events;
+    static int64_t last_ms;
+    uint32_t total_events = 0;
+    int active = 0;
+
+    shell_print(shell, "%-4s %-30s %-9s %-8s %8s %8s",
+                "door", "address", "link", "lock", "frames", "events");
+    for (int i = 0; i < MAX_DOORS; i++) {
+        struct door_state state;
+        char addr[BT_ADDR_LE_STR_LEN];
+
+        if (!door_get(i, &state)) {
+            continue;
         }
+        total_events += state.events;
+        active += state.connected;
+        bt_addr_le_to_str(&state.addr, addr, sizeof(addr));
+        shell_print(shell, "%-4d %-30s %-9s %-8s %8u %8u", i, addr,
+                    state.connected ? "up" : "down",
+                    state.door_locked ? "locked" : "unlocked",
+                    state.frames, state.events);
+    }
+
+    int64_t now = k_uptime_get();
+    if (last_ms) {
+        uint32_t elapsed_ms = (uint32_t)(now - last_ms);
+        uint32_t rate = elapsed_ms ? (total_events - last_events) * 1000U / elapsed_ms : 0;
+
+        shell_print(shell, "%d doors connected, %u events/s over the last %u ms",
+                    active, rate, elapsed_ms);
     } else {
-        shell_error(shell, "Unknown command: %s", argv[1]);
+        shell_print(shell, "%d doors connected, run again for the event rate", active);
+    }
+    last_events = total_events;
+    last_ms = now;
+    return 0;
+}
+
+/*
+ * Compare the old "type,value" text path (snprintf on the door node,
+ * sscanf/strcmp/atoi on the base node) against the TLV encoder/decoder.
+ * Target only: the base node has no native_sim build.
+ */
+static int bench(const struct shell *shell, size_t argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : BENCH_DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        shell_error(shell, "Usage: bench [iterations]");
         return -EINVAL;
     }
+
+    volatile int sink = 0;
+    uint32_t start = k_cycle_get_32();
+    for (int i = 0; i < iterations; i++) {
+        char msg[32];
+        char type[16];
+        char value;
+
+        snprintf(msg, sizeof(msg), "ultrasonic_s,%d", i & 0x1ff);
+        if (sscanf(msg, "%15[^,],%c", type, &value) == 2 &&
+            strcmp(type, "ultrasonic_s") == 0) {
+            sink += atoi(&msg[13]);
+        }
+    }
+    uint32_t text_cycles = k_cycle_get_32() - start;
+
+    start = k_cycle_get_32();
+    for (int i = 0; i < iterations; i++) {
+        uint8_t frame[8];
+        struct msg_writer writer;
+        struct msg_reader reader;
+        struct msg_record record;
+
+        msg_writer_init(&writer, frame, sizeof(frame));
+        msg_put_s16(&writer, MSG_TYPE_ULTRASONIC_SAMPLE, i & 0x1ff);
+        if (msg_reader_init(&reader, frame, writer.len) == 0 &&
+            msg_reader_next(&reader, &record) > 0 &&
+            record.type == MSG_TYPE_ULTRASONIC_SAMPLE) {
+            sink += msg_record_s16(&record);
+        }
+    }
+    uint32_t tlv_cycles = k_cycle_get_32() - start;
+
+    shell_print(shell, "text: %u cycles/msg (%u bytes)",
+                text_cycles / iterations, (unsigned int)strlen("ultrasonic_s,511"));
+    shell_print(shell, "tlv:  %u cycles/msg (%u bytes)",
+                tlv_cycles / iterations, MSG_HEADER_LEN + MSG_RECORD_HEADER_LEN + 2);
+    return 0;
+}
+
+static int parse_choice(const char *arg, const char *const *names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(arg, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -EINVAL;
+}
+
+/*
+ * Dump stored history as CSV so the host can pull it in one go:
+ * start_s,min,max,mean,count per line, oldest first.
+ */
+static int history(const struct shell *shell, size_t argc, char **argv) {
+    static const char *const metric_names[TS_METRIC_COUNT] = {
+        [TS_METRIC_DISTANCE] = "ultrasonic",
+        [TS_METRIC_MAGNETOMETER] = "magnetometer",
+    };
+    static const char *const res_names[TS_RES_COUNT] = {
+        [TS_RES_RAW] = "raw",
+        [TS_RES_1M] = "1m",
+        [TS_RES_15M] = "15m",
+    };
+    struct ts_point points[MAX(TS_RAW_LEN, MAX(TS_1M_LEN, TS_15M_LEN)) + 1];
+
+    if (argc == 3 && strcmp(argv[2], "clear") == 0) {
+        int id = parse_door_id(shell, argc, argv, 2);
+        if (id < 0) {
+            return id;
+        }
+        ts_clear(id);
+        shell_print(shell, "History cleared for door %d", id);
+        return 0;
+    }
+
+    if (argc < 4) {
+        shell_error(shell, "Usage: history <door> <ultrasonic|magnetometer> <raw|1m|15m> [count]");
+        shell_error(shell, "       history <door> clear");
+        return -EINVAL;
+    }
+
+    int id = parse_door_id(shell, argc, argv, 2);
+    int metric = parse_choice(argv[2], metric_names, TS_METRIC_COUNT);
+    int res = parse_choice(argv[3], res_names, TS_RES_COUNT);
+    if (id < 0 || metric < 0 || res < 0) {
+        shell_error(shell, "Unknown door, metric or resolution");
+        return -EINVAL;
+    }
+
+    size_t max_points = ARRAY_SIZE(points);
+    if (argc > 4) {
+        int count = atoi(argv[4]);
+        if (count <= 0) {
+            shell_error(shell, "Count must be positive");
+            return -EINVAL;
+        }
+        max_points = MIN((size_t)count, max_points);
+    }
+
+    size_t n = ts_read(id, metric, res, points, max_points);
+    shell_print(shell, "# door %d %s %s, %u points", id, metric_names[metric], res_names[res], n);
+    shell_print(shell, "start_s,min,max,mean,count");
+    for (size_t i = 0; i < n; i++) {
+        shell_print(shell, "%u,%d,%d,%d,%u", points[i].start_s, points[i].min, points[i].max,
+                    points[i].sum / points[i].count, points[i].count);
+    }
+    return 0;
+}
+
+static int telemetry(const struct shell *shell, size_t argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            telemetry_set_enabled(true);
+        } else if (strcmp(argv[1], "off") == 0) {
+            telemetry_set_enabled(false);
+        } else {
+            shell_error(shell, "Usage: telemetry [on|off]");
+            return -EINVAL;
+        }
+    }
+
+    shell_print(shell, "telemetry %s on %s UART, %u records sent, %u dropped",
+                telemetry_is_enabled() ? "on" : "off",
+                telemetry_has_dedicated_uart() ? "dedicated" : "console",
+                telemetry_records_sent(), telemetry_records_dropped());
     return 0;
+}
+
+/* Host link counters, with byte and frame rates since the previous call */
+static int host_link(const struct shell *shell, size_t argc, char **argv) {
+    static struct host_link_stats last;
+    static int64_t last_ms;
+    struct host_link_stats now;
+
+    if (!HOST_LINK_ENABLED) {
+        shell_print(shell, "host link not built in (use host_link.conf and host_link.overlay)");
+        return 0;
+    }
+
+    host_link_get_stats(&now);
+    int64_t now_ms = k_uptime_get();
+    uint32_t elapsed_ms = last_ms ? (uint32_t)(now_ms - last_ms) : 0;
 
+    shell_print(shell, "host link at %u baud", now.baudrate);
+    shell_print(shell, "rx: %u bytes, %u frames (%u copied), %u errors, %u dropped, %u stalls",
+                now.rx_bytes, now.rx_frames, now.rx_copied, now.rx_errors,
+                now.rx_dropped, now.rx_stalls);
+    shell_print(shell, "tx: %u bytes, %u frames, %u dropped; %u commands",
+                now.tx_bytes, now.tx_frames, now.tx_dropped, now.commands);
+    if (elapsed_ms) {
+        shell_print(shell, "rate: rx %u B/s %u frames/s, tx %u B/s %u frames/s",
+                    (now.rx_bytes - last.rx_bytes) * 1000U / elapsed_ms,
+                    (now.rx_frames - last.rx_frames) * 1000U / elapsed_ms,
+                    (now.tx_bytes - last.tx_bytes) * 1000U / elapsed_ms,
+                    (now.tx_frames - last.tx_frames) * 1000U / elapsed_ms);
+    }
+
+    last = now;
+    last_ms = now_ms;
+    return 0;
 }
 
 void register_shell_commands(void) {
-    SHELL_CMD_REGISTER(status, NULL, "Onboard led controll", read_sensor_data);
-    SHELL_CMD_REGISTER(door, NULL, "Door control", door);
+    SHELL_CMD_REGISTER(status, NULL, "Door sensor state: status [door]", read_sensor_data);
+    SHELL_CMD_REGISTER(door, NULL, "Door control: door [id] <lock|unlock|forget>", door);
+    SHELL_CMD_REGISTER(history, NULL, "Dump stored sensor history per door", history);
+    SHELL_CMD_REGISTER(telemetry, NULL, "Binary telemetry stream: telemetry [on|off]", telemetry);
+    SHELL_CMD_REGISTER(hostlink, NULL, "Host link throughput counters", host_link);
+    SHELL_CMD_REGISTER(doors, NULL, "Bonded doors and aggregate event rate", door_list);
+    SHELL_CMD_REGISTER(bench, NULL, "Benchmark text vs TLV message encode/decode", bench);
 }
 
@@ -2,14 +2,28 @@
 #include "rxBluetooth.h"
 #include "txBluetooth.h"
 #include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
 #include "servo.h"
 #include <stdbool.h>
-#include <stdlib.h>
 #include "localVariables.h"
+#include "msgProtocol.h"
+#include "timeSeries.h"
+#include "telemetry.h"
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/util.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DOOR_SETTINGS_KEY   "door"
+#define DOOR_KEY_LEN        (sizeof(DOOR_SETTINGS_KEY) + 4)
+
+struct door_state doors[MAX_DOORS];
+K_MUTEX_DEFINE(doors_lock);
 
-volatile int latest_distance_cm = -1;
-volatile int latest_avg_value = -1;
-volatile bool door_locked = -1;
+/* Link state only: which door record each peripheral connection belongs to, -1 for none */
+static int8_t conn_door[CONFIG_BT_MAX_CONN] = { [0 ... CONFIG_BT_MAX_CONN - 1] = -1 };
+volatile uint32_t rx_handoff_max_us = 0;
 
 struct relay_msg_t {
     char payload[21];
@@ -51,52 +65,381 @@ struct bt_uuid_128 tx_device_char_uuid = BT_UUID_INIT_128(
 
 char device_name[] = "display_node";
 
-void bluetooth_receiver0(void)
+/* Clear a record's link and sensor state; which door it belongs to is kept */
+static void door_reset(struct door_state *door, bool connected)
 {
-    bluetooth_advertiser();
-    char current_msg[21] = {0};
+    *door = (struct door_state) {
+        .assigned = door->assigned,
+        .addr = door->addr,
+        .connected = connected,
+        .latest_distance_cm = -1,
+        .latest_avg_value = -1,
+        .door_locked = true,
+    };
+}
+
+static void door_settings_key(uint8_t id, char *key, size_t size)
+{
+    snprintf(key, size, DOOR_SETTINGS_KEY "/%u", id);
+}
 
+static void door_store(uint8_t id)
+{
+    char key[DOOR_KEY_LEN];
 
-    while (1) {
-        const char *msg = get_received_data();
-
-        // Check for new message
-        if (strncmp(current_msg, msg, sizeof(current_msg)) != 0) {
-            strncpy(current_msg, msg, sizeof(current_msg) - 1);
-            current_msg[sizeof(current_msg) - 1] = '\0';
-            char type[16];
-            char value;
-
-            if (sscanf(current_msg, "%20[^,],%c", type, &value) == 2) {
-
-                if (strcmp(type, "pin") == 0) {
-                    const char *pin = &current_msg[4];
-                    printk("pin: %s\n", pin);
-                } else if (strcmp(type, "ultrasonic") == 0) {
-                    if (value == '1') {
-                        set_servo_locked(false);
-                        door_locked = false;
-                    } else if (value == '0') {
-                        set_servo_locked(true);
-                        door_locked = true;
-                    } 
-                } else if (strcmp(type, "magnetometer") == 0) {
-                    if (value == '1') {
-                    } else if (value == '0') {
-                    } 
-                } else if (strcmp(type, "ultrasonic_s") == 0) {
-                    latest_distance_cm = atoi(&current_msg[13]);
-                } else if (strcmp(type, "magnetometer_s") == 0) {
-                    latest_avg_value = atoi(&current_msg[15]);
-                } else {
-                }
+    if (!IS_ENABLED(CONFIG_SETTINGS)) {
+        return;
+    }
+
+    door_settings_key(id, key, sizeof(key));
+    int err = doors[id].assigned ?
+              settings_save_one(key, &doors[id].addr, sizeof(doors[id].addr)) :
+              settings_delete(key);
+    if (err) {
+        printk("Failed to store door %u (err %d)\n", id, err);
+    }
+}
+
+/* Restores "door/<id>" = identity address, loaded by settings_load() in bluetooth_advertiser() */
+static int door_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+    char *end;
+    long id = strtol(name, &end, 10);
+
+    if (*end != '\0' || id < 0 || id >= MAX_DOORS || len != sizeof(bt_addr_le_t)) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    int ret = read_cb(cb_arg, &doors[id].addr, len);
+    doors[id].assigned = ret == (int)len;
+    k_mutex_unlock(&doors_lock);
+
+    return ret == (int)len ? 0 : -EINVAL;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(door, DOOR_SETTINGS_KEY, NULL, door_settings_set, NULL, NULL);
+
+/* Record id for an address, or -ENOENT; call with doors_lock held */
+static int door_find(const bt_addr_le_t *addr)
+{
+    for (int i = 0; i < MAX_DOORS; i++) {
+        if (doors[i].assigned && bt_addr_le_eq(&doors[i].addr, addr)) {
+            return i;
+        }
+    }
+    return -ENOENT;
+}
+
+/* The address's record, or a newly assigned free one; call with doors_lock held */
+static int door_find_or_assign(const bt_addr_le_t *addr)
+{
+    int id = door_find(addr);
+    if (id >= 0) {
+        return id;
+    }
+
+    for (int i = 0; i < MAX_DOORS; i++) {
+        if (!doors[i].assigned) {
+            doors[i].assigned = true;
+            bt_addr_le_copy(&doors[i].addr, addr);
+            door_store(i);
+            return i;
+        }
+    }
+    return -ENOMEM;
+}
+
+static bool is_peripheral(struct bt_conn *conn)
+{
+    struct bt_conn_info info;
+
+    return bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_PERIPHERAL;
+}
+
+/* Attach a secured link to door record id; call with doors_lock held */
+static void door_bind(uint8_t slot, int id)
+{
+    if (!doors[id].connected) {
+        conn_door[slot] = id;
+        door_reset(&doors[id], true);
+    }
+}
+
+/*
+ * Door nodes connect to us; our own central link to the display never
+ * lands here. Frames need an encrypted link, so a known door is matched
+ * to its record once the link is secured, by which point a bonded peer
+ * shows its identity address. Any central can bond with us, so a new
+ * peer only gets a record from door_admit(), on its first door frame.
+ */
+static void door_security_changed(struct bt_conn *conn, bt_security_t level,
+                                  enum bt_security_err err)
+{
+    if (err || level < BT_SECURITY_L2 || !is_peripheral(conn)) {
+        return;
+    }
+
+    uint8_t slot = bt_conn_index(conn);
+    char addr_str[BT_ADDR_LE_STR_LEN];
+
+    bt_addr_le_to_str(bt_conn_get_dst(conn), addr_str, sizeof(addr_str));
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    int id = door_find(bt_conn_get_dst(conn));
+    if (id >= 0) {
+        door_bind(slot, id);
+    }
+    k_mutex_unlock(&doors_lock);
+
+    if (id < 0) {
+        printk("%s secured, waiting for its first door frame\n", addr_str);
+    } else {
+        printk("door %d connected (%s)\n", id, addr_str);
+    }
+}
+
+/* A fresh pairing learns the identity address after the link was secured under the RPA */
+static void door_identity_resolved(struct bt_conn *conn, const bt_addr_le_t *rpa,
+                                   const bt_addr_le_t *identity)
+{
+    if (!is_peripheral(conn)) {
+        return;
+    }
+
+    uint8_t slot = bt_conn_index(conn);
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    int id = conn_door[slot];
+    if (id < 0) {
+        // No frame yet: a known door that re-paired gets its record back now
+        id = door_find(identity);
+        if (id >= 0) {
+            door_bind(slot, id);
+        }
+    } else if (bt_addr_le_eq(&doors[id].addr, rpa)) {
+        int known = door_find(identity);
+
+        if (known >= 0) {
+            // A door we already knew, re-paired: it keeps its old record
+            doors[id].assigned = false;
+            doors[id].connected = false;
+            door_store(id);
+            id = known;
+            conn_door[slot] = id;
+            door_reset(&doors[id], true);
+        } else {
+            bt_addr_le_copy(&doors[id].addr, identity);
+            door_store(id);
+        }
+    }
+    k_mutex_unlock(&doors_lock);
+}
+
+static void door_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    if (!is_peripheral(conn)) {
+        return;
+    }
+
+    uint8_t slot = bt_conn_index(conn);
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    int id = conn_door[slot];
+    conn_door[slot] = -1;
+    if (id >= 0) {
+        doors[id].connected = false;
+    }
+    k_mutex_unlock(&doors_lock);
+
+    if (id >= 0) {
+        printk("door %d disconnected\n", id);
+    }
+}
+
+BT_CONN_CB_DEFINE(door_conn_callbacks) = {
+    .security_changed = door_security_changed,
+    .identity_resolved = door_identity_resolved,
+    .disconnected = door_disconnected,
+};
+
+bool door_get(uint8_t id, struct door_state *out)
+{
+    if (id >= MAX_DOORS) {
+        return false;
+    }
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    *out = doors[id];
+    k_mutex_unlock(&doors_lock);
+    return out->assigned;
+}
+
+int door_set_locked(uint8_t id, bool locked)
+{
+    int ret;
+
+    if (id >= MAX_DOORS) {
+        return -ENOENT;
+    }
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    if (!doors[id].assigned) {
+        ret = -ENOENT;
+    } else if (doors[id].door_locked == locked) {
+        ret = -EALREADY;
+    } else {
+        ret = set_servo_locked(id, locked);
+        if (ret == 0) {
+            doors[id].door_locked = locked;
+            telemetry_publish_lock(id, locked);
+        }
+    }
+    k_mutex_unlock(&doors_lock);
+    return ret;
+}
+
+int door_forget(uint8_t id)
+{
+    if (id >= MAX_DOORS) {
+        return -ENOENT;
+    }
+
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    int ret = doors[id].connected ? -EBUSY : 0;
+    if (ret == 0) {
+        doors[id].assigned = false;
+        door_reset(&doors[id], false);
+        door_store(id);
+        ts_clear(id);
+    }
+    k_mutex_unlock(&doors_lock);
+    return ret;
+}
+
+/* Call with doors_lock held */
+static void handle_door_frame(uint8_t id, const uint8_t *buf, uint16_t len)
+{
+    struct door_state *door = &doors[id];
+    struct msg_reader reader;
+    struct msg_record record;
+
+    if (msg_reader_init(&reader, buf, len) != 0) {
+        printk("Unsupported message version\n");
+        return;
+    }
+    door->frames++;
+
+    while (msg_reader_next(&reader, &record) > 0) {
+        door->events++;
+
+        switch (record.type) {
+        case MSG_TYPE_PIN:
+            printk("door %u pin: %.*s\n", id, record.len, record.value);
+            break;
+        case MSG_TYPE_PROXIMITY: {
+            bool locked = !msg_record_u8(&record);
+            int err = set_servo_locked(id, locked);
+
+            if (err) {
+                door->servo_errors++;
+                printk("door %u servo not driven (err %d)\n", id, err);
             } else {
+                door->door_locked = locked;
             }
+            break;
+        }
+        case MSG_TYPE_DOOR_OPEN:
+            break;
+        case MSG_TYPE_ULTRASONIC_SAMPLE:
+            door->latest_distance_cm = msg_record_s16(&record);
+            ts_record(id, TS_METRIC_DISTANCE, door->latest_distance_cm);
+            break;
+        case MSG_TYPE_MAGNETOMETER_SAMPLE:
+            door->latest_avg_value = msg_record_s16(&record);
+            ts_record(id, TS_METRIC_MAGNETOMETER, door->latest_avg_value);
+            break;
+        default:
+            break;
         }
+    }
+}
+
+/*
+ * First frame from a link with no door record. Only a peer that writes a
+ * well-formed door frame gets one; call with doors_lock held.
+ */
+static int door_admit(const struct rx_msg *msg)
+{
+    struct msg_reader reader;
+    struct msg_record record;
+
+    if (msg_reader_init(&reader, msg->data, msg->len) != 0 ||
+        msg_reader_next(&reader, &record) <= 0) {
+        return -EINVAL;
+    }
+
+    // The writer may have left, and its slot been reused, while the frame was queued
+    struct bt_conn *conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, &msg->peer);
+    if (!conn) {
+        return -ENOTCONN;
+    }
+    bool live = bt_conn_index(conn) == msg->conn_index && is_peripheral(conn) &&
+                bt_conn_get_security(conn) >= BT_SECURITY_L2;
+    bt_conn_unref(conn);
+    if (!live) {
+        return -ENOTCONN;
+    }
+
+    char addr_str[BT_ADDR_LE_STR_LEN];
+    int id = door_find_or_assign(&msg->peer);
 
-        k_sleep(K_MSEC(50));
+    bt_addr_le_to_str(&msg->peer, addr_str, sizeof(addr_str));
+    if (id < 0) {
+        printk("No free door record for %s\n", addr_str);
+        return id;
     }
+
+    door_bind(msg->conn_index, id);
+    printk("door %d connected (%s)\n", id, addr_str);
+    return id;
 }
 
+void bluetooth_receiver0(void)
+{
+    k_mutex_lock(&doors_lock, K_FOREVER);
+    for (int i = 0; i < MAX_DOORS; i++) {
+        door_reset(&doors[i], false);
+    }
+    k_mutex_unlock(&doors_lock);
+
+    // Also restores the door records
+    bluetooth_advertiser();
+
+
+    while (1) {
+        struct rx_msg msg;
+
+        // Block until the next write from any door node
+        if (get_received_msg(&msg, K_FOREVER) != 0) {
+            continue;
+        }
 
+        uint32_t handoff_us = k_cyc_to_us_floor32(k_cycle_get_32() - msg.timestamp);
+        if (handoff_us > rx_handoff_max_us) {
+            rx_handoff_max_us = handoff_us;
+        }
 
+        // Frames follow the writer's identity, not the connection slot it happens to use
+        k_mutex_lock(&doors_lock, K_FOREVER);
+        int id = door_find(&msg.peer);
+        if (id < 0) {
+            id = door_admit(&msg);
+        }
+        if (id >= 0) {
+            handle_door_frame(id, msg.data, msg.len);
+            telemetry_publish(id, msg.data, msg.len);
+        }
+        k_mutex_unlock(&doors_lock);
+    }
+}
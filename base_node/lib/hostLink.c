@@ -0,0 +1,405 @@
+#include "hostLink.h"
+#include <zephyr/kernel.h>
+#include <string.h>
+
+#if HOST_LINK_ENABLED
+
+#include "baseBluetooth.h"
+#include "localVariables.h"
+#include "msgProtocol.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+
+#define HOST_UART_NODE      DT_CHOSEN(slarm_host_uart)
+#define HOST_FRAME_MIN      (1 + MSG_HEADER_LEN + 2)
+
+static const struct device *const host_uart = DEVICE_DT_GET(HOST_UART_NODE);
+
+/* Queued by the UART callback when reception stops, so the receiver can restart it */
+#define HOST_FRAME_RESTART  (-2)
+
+/*
+ * A received frame, still COBS encoded; block is -1 for the straddle
+ * buffer, or HOST_FRAME_RESTART for a restart request with no data.
+ */
+struct host_frame {
+    uint8_t *data;
+    uint16_t len;
+    int8_t block;
+};
+
+K_MSGQ_DEFINE(host_rx_q, sizeof(struct host_frame), HOST_LINK_RX_QUEUE_LEN, 4);
+
+static struct host_link_stats stats;
+
+/* RX DMA blocks; the UART holds one reference while it owns a block, each queued frame another */
+static uint8_t rx_blocks[HOST_LINK_RX_BUF_COUNT][HOST_LINK_RX_BUF_SIZE] __aligned(4);
+static atomic_t rx_refs[HOST_LINK_RX_BUF_COUNT];
+static struct k_mem_slab rx_slab;
+static atomic_t rx_stopped;
+
+/* Frame in progress: either a span of the current block or copied into straddle_buf */
+static struct {
+    uint8_t *start;
+    size_t len;
+    bool straddling;
+    bool owns_straddle;
+    bool overflow;
+} rx_frame;
+static uint8_t straddle_buf[HOST_LINK_FRAME_MAX];
+static atomic_t straddle_busy;
+
+static uint8_t tx_bufs[2][HOST_LINK_TX_BUF_SIZE] __aligned(4);
+static size_t tx_fill_len;
+static uint8_t tx_fill;
+static bool tx_busy;
+static struct k_spinlock tx_lock;
+/* Set once uart_cb is registered; TX DONE would never clear tx_busy before that */
+static atomic_t tx_ready;
+
+static int block_index(const uint8_t *buf)
+{
+    return (buf - &rx_blocks[0][0]) / HOST_LINK_RX_BUF_SIZE;
+}
+
+static void block_release(int block)
+{
+    if (block >= 0 && atomic_dec(&rx_refs[block]) == 1) {
+        k_mem_slab_free(&rx_slab, rx_blocks[block]);
+    }
+}
+
+static uint8_t *block_alloc(void)
+{
+    void *buf;
+
+    if (k_mem_slab_alloc(&rx_slab, &buf, K_NO_WAIT) != 0) {
+        return NULL;
+    }
+    atomic_set(&rx_refs[block_index(buf)], 1);
+    return buf;
+}
+
+static void frame_reset(void)
+{
+    rx_frame.start = NULL;
+    rx_frame.len = 0;
+    rx_frame.straddling = false;
+    rx_frame.owns_straddle = false;
+    rx_frame.overflow = false;
+}
+
+/* Move the frame in progress out of a block the UART is about to give back */
+static void frame_straddle(void)
+{
+    if (rx_frame.straddling || rx_frame.overflow || !rx_frame.len) {
+        return;
+    }
+    // The receiver thread may still be decoding the previous straddling frame
+    rx_frame.owns_straddle = atomic_cas(&straddle_busy, 0, 1);
+    if (rx_frame.owns_straddle) {
+        memcpy(straddle_buf, rx_frame.start, rx_frame.len);
+    } else {
+        rx_frame.overflow = true;
+    }
+    rx_frame.straddling = true;
+}
+
+static void frame_append(uint8_t *pos, size_t len)
+{
+    if (rx_frame.overflow) {
+        return;
+    }
+    if (rx_frame.len + len > HOST_LINK_FRAME_MAX) {
+        rx_frame.overflow = true;
+    } else if (rx_frame.straddling) {
+        memcpy(&straddle_buf[rx_frame.len], pos, len);
+    } else if (!rx_frame.len) {
+        rx_frame.start = pos;
+    }
+    rx_frame.len += len;
+}
+
+static void frame_complete(void)
+{
+    struct host_frame frame = {
+        .data = rx_frame.straddling ? straddle_buf : rx_frame.start,
+        .len = rx_frame.len,
+        .block = rx_frame.straddling ? -1 : block_index(rx_frame.start),
+    };
+
+    if (!rx_frame.len) {
+        return;
+    }
+    if (rx_frame.overflow) {
+        stats.rx_dropped++;
+        if (rx_frame.owns_straddle) {
+            atomic_clear(&straddle_busy);
+        }
+        return;
+    }
+
+    if (frame.block >= 0) {
+        atomic_inc(&rx_refs[frame.block]);
+    }
+    if (k_msgq_put(&host_rx_q, &frame, K_NO_WAIT) != 0) {
+        stats.rx_dropped++;
+        if (frame.block >= 0) {
+            block_release(frame.block);
+        } else {
+            atomic_clear(&straddle_busy);
+        }
+        return;
+    }
+    stats.rx_frames++;
+    if (frame.block < 0) {
+        stats.rx_copied++;
+    }
+}
+
+/* Split newly received bytes on the 0x00 delimiter; runs in the UART ISR */
+static void rx_ready(uint8_t *buf, size_t offset, size_t len)
+{
+    uint8_t *pos = buf + offset;
+    uint8_t *end = pos + len;
+
+    stats.rx_bytes += len;
+
+    while (pos < end) {
+        uint8_t *delim = memchr(pos, 0, end - pos);
+
+        if (!delim) {
+            frame_append(pos, end - pos);
+            break;
+        }
+        frame_append(pos, delim - pos);
+        frame_complete();
+        frame_reset();
+        pos = delim + 1;
+    }
+}
+
+static void rx_start(void)
+{
+    uint8_t *buf = block_alloc();
+
+    if (!buf) {
+        atomic_set(&rx_stopped, 1);
+        return;
+    }
+    atomic_set(&rx_stopped, 0);
+    if (uart_rx_enable(host_uart, buf, HOST_LINK_RX_BUF_SIZE, HOST_LINK_RX_TIMEOUT_US) != 0) {
+        block_release(block_index(buf));
+        atomic_set(&rx_stopped, 1);
+    }
+}
+
+static void tx_kick_locked(void)
+{
+    if (tx_busy || !tx_fill_len) {
+        return;
+    }
+
+    uint8_t *buf = tx_bufs[tx_fill];
+    size_t len = tx_fill_len;
+
+    tx_fill ^= 1;
+    tx_fill_len = 0;
+    tx_busy = true;
+    if (uart_tx(host_uart, buf, len, SYS_FOREVER_US) != 0) {
+        tx_busy = false;
+        stats.tx_dropped++;
+    }
+}
+
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+    k_spinlock_key_t key;
+    uint8_t *buf;
+
+    switch (evt->type) {
+    case UART_TX_DONE:
+    case UART_TX_ABORTED:
+        key = k_spin_lock(&tx_lock);
+        stats.tx_bytes += evt->data.tx.len;
+        tx_busy = false;
+        tx_kick_locked();
+        k_spin_unlock(&tx_lock, key);
+        break;
+    case UART_RX_RDY:
+        rx_ready(evt->data.rx.buf, evt->data.rx.offset, evt->data.rx.len);
+        break;
+    case UART_RX_BUF_REQUEST:
+        buf = block_alloc();
+        if (buf) {
+            uart_rx_buf_rsp(dev, buf, HOST_LINK_RX_BUF_SIZE);
+        } else {
+            // The UART stops when the current block fills; the receiver restarts it
+            stats.rx_stalls++;
+        }
+        break;
+    case UART_RX_BUF_RELEASED:
+        if (rx_frame.len && !rx_frame.straddling &&
+            block_index(rx_frame.start) == block_index(evt->data.rx_buf.buf)) {
+            frame_straddle();
+        }
+        block_release(block_index(evt->data.rx_buf.buf));
+        break;
+    case UART_RX_STOPPED:
+        stats.rx_errors++;
+        break;
+    case UART_RX_DISABLED: {
+        struct host_frame restart = { .block = HOST_FRAME_RESTART };
+
+        // A full queue needs no marker: the receiver checks rx_stopped after every frame
+        atomic_set(&rx_stopped, 1);
+        k_msgq_put(&host_rx_q, &restart, K_NO_WAIT);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+/* Undo COBS in place; returns the decoded length or -EINVAL */
+static int cobs_decode_in_place(uint8_t *buf, size_t len)
+{
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+
+        if (code == 0 || in + code - 1 > len) {
+            return -EINVAL;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        if (code < 0xff && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static int handle_host_frame(const uint8_t *frame, size_t len)
+{
+    struct msg_reader reader;
+    struct msg_record record;
+
+    if (len < HOST_FRAME_MIN ||
+        crc16_itu_t(0xffff, frame, len - 2) != sys_get_le16(&frame[len - 2])) {
+        return -EBADMSG;
+    }
+
+    uint8_t id = frame[0];
+    struct door_state door;
+    if (msg_reader_init(&reader, &frame[1], len - 3) != 0) {
+        return -EINVAL;
+    }
+    // Only a door that is up can be commanded; its servo state would otherwise go stale
+    if (!door_get(id, &door) || !door.connected) {
+        return -ENOTCONN;
+    }
+
+    while (msg_reader_next(&reader, &record) > 0) {
+        if (record.type == MSG_TYPE_LOCK_STATE) {
+            int err = door_set_locked(id, msg_record_u8(&record));
+
+            if (err && err != -EALREADY) {
+                return err;
+            }
+            stats.commands++;
+        }
+    }
+    return 0;
+}
+
+int host_link_write(const uint8_t *data, size_t len)
+{
+    if (!atomic_get(&tx_ready)) {
+        return -EAGAIN;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+    if (tx_fill_len + len > HOST_LINK_TX_BUF_SIZE) {
+        stats.tx_dropped++;
+        k_spin_unlock(&tx_lock, key);
+        return -ENOMEM;
+    }
+
+    memcpy(&tx_bufs[tx_fill][tx_fill_len], data, len);
+    tx_fill_len += len;
+    stats.tx_frames++;
+    tx_kick_locked();
+
+    k_spin_unlock(&tx_lock, key);
+    return 0;
+}
+
+void host_link_get_stats(struct host_link_stats *out)
+{
+    *out = stats;
+    out->baudrate = DT_PROP(HOST_UART_NODE, current_speed);
+}
+
+void host_link_receiver(void)
+{
+    k_mem_slab_init(&rx_slab, rx_blocks, HOST_LINK_RX_BUF_SIZE, HOST_LINK_RX_BUF_COUNT);
+
+    if (!device_is_ready(host_uart) || uart_callback_set(host_uart, uart_cb, NULL) != 0) {
+        printk("Host link UART not available\n");
+        return;
+    }
+    atomic_set(&tx_ready, 1);
+    rx_start();
+
+    while (1) {
+        struct host_frame frame;
+
+        // Sleeps until a frame arrives or the UART reports that reception stopped
+        k_msgq_get(&host_rx_q, &frame, K_FOREVER);
+
+        if (frame.block != HOST_FRAME_RESTART) {
+            int len = cobs_decode_in_place(frame.data, frame.len);
+
+            if (len < 0 || handle_host_frame(frame.data, len) != 0) {
+                stats.rx_errors++;
+            }
+
+            if (frame.block < 0) {
+                atomic_clear(&straddle_busy);
+            } else {
+                block_release(frame.block);
+            }
+        }
+
+        /*
+         * Once the UART is disabled only queued frames hold blocks, so
+         * freeing them here is the only way a stalled receiver gets a
+         * block to restart with.
+         */
+        if (atomic_get(&rx_stopped)) {
+            rx_start();
+        }
+    }
+}
+
+#else
+
+int host_link_write(const uint8_t *data, size_t len)
+{
+    return -ENODEV;
+}
+
+void host_link_get_stats(struct host_link_stats *out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+#endif // HOST_LINK_ENABLED
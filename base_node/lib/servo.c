@@ -8,25 +8,48 @@
 #define LOCKED_PULSE_US     2500U       // 2.5 ms pulse for locked
 #define UNLOCKED_PULSE_US   700U       // 0.7 ms pulse for unlocked
 
-static const struct pwm_dt_spec servo_pwm = PWM_DT_SPEC_GET(DT_ALIAS(pwm_servo));
+/*
+ * Door n drives the servo behind alias pwm-servo (door 0) or pwm-servo<n>.
+ * Slots stay at their index even when an alias is missing, so a gap in
+ * the devicetree never moves another door's servo.
+ */
+static const struct pwm_dt_spec servos[SERVO_COUNT] = {
+#if DT_NODE_EXISTS(DT_ALIAS(pwm_servo))
+    [0] = PWM_DT_SPEC_GET(DT_ALIAS(pwm_servo)),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(pwm_servo1))
+    [1] = PWM_DT_SPEC_GET(DT_ALIAS(pwm_servo1)),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(pwm_servo2))
+    [2] = PWM_DT_SPEC_GET(DT_ALIAS(pwm_servo2)),
+#endif
+#if DT_NODE_EXISTS(DT_ALIAS(pwm_servo3))
+    [3] = PWM_DT_SPEC_GET(DT_ALIAS(pwm_servo3)),
+#endif
+};
 
-void set_servo_locked(bool locked)
+int set_servo_locked(uint8_t door, bool locked)
 {
-    if (!pwm_is_ready_dt(&servo_pwm)) {
-        printk("PWM device %s not ready\n", servo_pwm.dev->name);
-        return;
+    if (door >= ARRAY_SIZE(servos) || !servos[door].dev) {
+        return -ENODEV;
+    }
+
+    const struct pwm_dt_spec *servo_pwm = &servos[door];
+    if (!pwm_is_ready_dt(servo_pwm)) {
+        printk("PWM device %s not ready\n", servo_pwm->dev->name);
+        return -ENODEV;
     }
 
     uint32_t pulse = locked ? LOCKED_PULSE_US : UNLOCKED_PULSE_US;
 
-    int ret = pwm_set_dt(&servo_pwm,
+    int ret = pwm_set_dt(servo_pwm,
                          PWM_USEC(PWM_PERIOD_US),
                          PWM_USEC(pulse));
 
     if (ret < 0) {
-        printk("Failed to move servo to %s position (err %d)\n",
-               locked ? "locked" : "unlocked", ret);
-    } else {
+        printk("Failed to move servo %u to %s position (err %d)\n",
+               door, locked ? "locked" : "unlocked", ret);
     }
+    return ret;
 }
 
@@ -0,0 +1,172 @@
+#include "telemetry.h"
+#include "hostLink.h"
+#include "msgProtocol.h"
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <string.h>
+
+#if HOST_LINK_ENABLED
+#define TELEMETRY_DEDICATED     true
+#elif DT_HAS_CHOSEN(slarm_telemetry_uart)
+#define TELEMETRY_UART_NODE     DT_CHOSEN(slarm_telemetry_uart)
+#define TELEMETRY_DEDICATED     true
+#else
+#define TELEMETRY_UART_NODE     DT_CHOSEN(zephyr_console)
+#define TELEMETRY_DEDICATED     false
+#endif
+
+#define TELEMETRY_RECORD_MAX    (TELEMETRY_HEADER_LEN + TELEMETRY_MAX_PAYLOAD + TELEMETRY_CRC_LEN)
+/* COBS adds one byte per 254 plus the leading code byte */
+#define TELEMETRY_ENCODED_MAX   (TELEMETRY_RECORD_MAX + TELEMETRY_RECORD_MAX / 254 + 2)
+/* Encoded records waiting for the console UART; a full ring drops new records */
+#define TELEMETRY_RING_SIZE     (4 * TELEMETRY_ENCODED_MAX)
+#define TELEMETRY_CHUNK_LEN     32
+
+#ifdef TELEMETRY_UART_NODE
+static const struct device *const telemetry_uart = DEVICE_DT_GET(TELEMETRY_UART_NODE);
+#endif
+static bool telemetry_enabled = TELEMETRY_DEDICATED;
+static uint32_t records_sent;
+static uint32_t records_dropped;
+
+K_MUTEX_DEFINE(telemetry_lock);
+static uint8_t record_buf[TELEMETRY_RECORD_MAX];
+static uint8_t encoded_buf[TELEMETRY_ENCODED_MAX];
+#if !HOST_LINK_ENABLED
+RING_BUF_DECLARE(telemetry_ring, TELEMETRY_RING_SIZE);
+K_SEM_DEFINE(telemetry_ring_sem, 0, 1);
+#endif
+
+/* Consistent Overhead Byte Stuffing: removes every 0x00 so it can delimit records */
+static size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    size_t code_pos = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] != 0) {
+            dst[out++] = src[i];
+            code++;
+        }
+        if (src[i] == 0 || code == 0xff) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code = 1;
+        }
+    }
+    dst[code_pos] = code;
+
+    return out;
+}
+
+static void telemetry_send(uint8_t door, const uint8_t *frame, uint16_t len)
+{
+    if (!telemetry_enabled || len > TELEMETRY_MAX_PAYLOAD) {
+        return;
+    }
+
+    k_mutex_lock(&telemetry_lock, K_FOREVER);
+
+    record_buf[0] = door;
+    sys_put_le32(k_uptime_get_32(), &record_buf[1]);
+    memcpy(&record_buf[TELEMETRY_HEADER_LEN], frame, len);
+
+    size_t record_len = TELEMETRY_HEADER_LEN + len;
+    sys_put_le16(crc16_itu_t(0xffff, record_buf, record_len), &record_buf[record_len]);
+    record_len += TELEMETRY_CRC_LEN;
+
+    size_t encoded_len = cobs_encode(record_buf, record_len, encoded_buf);
+    encoded_buf[encoded_len++] = 0x00;
+
+#if HOST_LINK_ENABLED
+    if (host_link_write(encoded_buf, encoded_len) == 0) {
+        records_sent++;
+    }
+#else
+    // Callers may hold doors_lock: polled output happens in telemetry_sender()
+    if (ring_buf_space_get(&telemetry_ring) >= encoded_len) {
+        ring_buf_put(&telemetry_ring, encoded_buf, encoded_len);
+        records_sent++;
+        k_sem_give(&telemetry_ring_sem);
+    } else {
+        records_dropped++;
+    }
+#endif
+
+    k_mutex_unlock(&telemetry_lock);
+}
+
+#if !HOST_LINK_ENABLED
+void telemetry_sender(void)
+{
+    if (!device_is_ready(telemetry_uart)) {
+        printk("Telemetry UART not ready\n");
+        return;
+    }
+
+    while (1) {
+        uint8_t chunk[TELEMETRY_CHUNK_LEN];
+        uint32_t len;
+
+        k_sem_take(&telemetry_ring_sem, K_FOREVER);
+        do {
+            k_mutex_lock(&telemetry_lock, K_FOREVER);
+            len = ring_buf_get(&telemetry_ring, chunk, sizeof(chunk));
+            k_mutex_unlock(&telemetry_lock);
+
+            for (uint32_t i = 0; i < len; i++) {
+                uart_poll_out(telemetry_uart, chunk[i]);
+            }
+        } while (len);
+    }
+}
+#endif
+
+void telemetry_publish(uint8_t door, const uint8_t *frame, uint16_t len)
+{
+    telemetry_send(door, frame, len);
+}
+
+void telemetry_publish_lock(uint8_t door, bool locked)
+{
+    uint8_t frame[MSG_HEADER_LEN + MSG_RECORD_HEADER_LEN + 1];
+    struct msg_writer writer;
+
+    if (!telemetry_enabled) {
+        return;
+    }
+
+    msg_writer_init(&writer, frame, sizeof(frame));
+    msg_put_u8(&writer, MSG_TYPE_LOCK_STATE, locked);
+    telemetry_send(door, frame, writer.len);
+}
+
+void telemetry_set_enabled(bool enabled)
+{
+    telemetry_enabled = enabled;
+}
+
+bool telemetry_is_enabled(void)
+{
+    return telemetry_enabled;
+}
+
+bool telemetry_has_dedicated_uart(void)
+{
+    return TELEMETRY_DEDICATED;
+}
+
+uint32_t telemetry_records_sent(void)
+{
+    return records_sent;
+}
+
+uint32_t telemetry_records_dropped(void)
+{
+    return records_dropped;
+}
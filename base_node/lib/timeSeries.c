@@ -0,0 +1,137 @@
+#include "timeSeries.h"
+#include "localVariables.h"
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <string.h>
+
+static const uint32_t period_s[TS_RES_COUNT] = {
+    [TS_RES_RAW] = 0,
+    [TS_RES_1M] = 60,
+    [TS_RES_15M] = 15 * 60,
+};
+
+static const uint8_t ring_len[TS_RES_COUNT] = {
+    [TS_RES_RAW] = TS_RAW_LEN,
+    [TS_RES_1M] = TS_1M_LEN,
+    [TS_RES_15M] = TS_15M_LEN,
+};
+
+struct ts_ring {
+    struct ts_point *points;
+    uint8_t head;
+    uint8_t count;
+    struct ts_point open;   /* bucket still being filled; count == 0 when none */
+};
+
+struct ts_series {
+    struct ts_point raw[TS_RAW_LEN];
+    struct ts_point minute[TS_1M_LEN];
+    struct ts_point quarter[TS_15M_LEN];
+    struct ts_ring rings[TS_RES_COUNT];
+};
+
+static struct ts_series series[MAX_DOORS][TS_METRIC_COUNT];
+static struct k_spinlock ts_lock;
+
+static struct ts_ring *ts_ring_get(uint8_t door, enum ts_metric metric, enum ts_resolution res)
+{
+    struct ts_series *s = &series[door][metric];
+
+    // Rings are wired to their storage on first use, so the table can stay zero-initialised
+    if (!s->rings[TS_RES_RAW].points) {
+        s->rings[TS_RES_RAW].points = s->raw;
+        s->rings[TS_RES_1M].points = s->minute;
+        s->rings[TS_RES_15M].points = s->quarter;
+    }
+    return &s->rings[res];
+}
+
+static void ts_ring_push(struct ts_ring *ring, enum ts_resolution res, const struct ts_point *point)
+{
+    ring->points[ring->head] = *point;
+    ring->head = (ring->head + 1) % ring_len[res];
+    if (ring->count < ring_len[res]) {
+        ring->count++;
+    }
+}
+
+static void ts_point_add(struct ts_point *point, int16_t value)
+{
+    if (!point->count) {
+        point->min = value;
+        point->max = value;
+    } else {
+        point->min = MIN(point->min, value);
+        point->max = MAX(point->max, value);
+    }
+    point->sum += value;
+    point->count++;
+}
+
+void ts_record(uint8_t door, enum ts_metric metric, int16_t value)
+{
+    if (door >= MAX_DOORS || metric >= TS_METRIC_COUNT) {
+        return;
+    }
+
+    uint32_t now_s = (uint32_t)(k_uptime_get() / MSEC_PER_SEC);
+    k_spinlock_key_t key = k_spin_lock(&ts_lock);
+
+    struct ts_point raw = { .start_s = now_s };
+    ts_point_add(&raw, value);
+    ts_ring_push(ts_ring_get(door, metric, TS_RES_RAW), TS_RES_RAW, &raw);
+
+    for (int res = TS_RES_1M; res < TS_RES_COUNT; res++) {
+        struct ts_ring *ring = ts_ring_get(door, metric, res);
+        uint32_t start_s = now_s - now_s % period_s[res];
+
+        if (ring->open.count && ring->open.start_s != start_s) {
+            ts_ring_push(ring, res, &ring->open);
+            ring->open.count = 0;
+        }
+        if (!ring->open.count) {
+            ring->open = (struct ts_point) { .start_s = start_s };
+        }
+        ts_point_add(&ring->open, value);
+    }
+
+    k_spin_unlock(&ts_lock, key);
+}
+
+size_t ts_read(uint8_t door, enum ts_metric metric, enum ts_resolution res,
+               struct ts_point *points, size_t max_points)
+{
+    if (door >= MAX_DOORS || metric >= TS_METRIC_COUNT || res >= TS_RES_COUNT || !max_points) {
+        return 0;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&ts_lock);
+
+    const struct ts_ring *ring = ts_ring_get(door, metric, res);
+    bool has_open = ring->open.count != 0;
+    size_t available = ring->count + has_open;
+    size_t n = MIN(available, max_points);
+    size_t from_ring = n - (has_open ? 1 : 0);
+    size_t len = ring_len[res];
+
+    for (size_t i = 0; i < from_ring; i++) {
+        points[i] = ring->points[(ring->head + len - from_ring + i) % len];
+    }
+    if (has_open) {
+        points[from_ring] = ring->open;
+    }
+
+    k_spin_unlock(&ts_lock, key);
+    return n;
+}
+
+void ts_clear(uint8_t door)
+{
+    if (door >= MAX_DOORS) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&ts_lock);
+    memset(series[door], 0, sizeof(series[door]));
+    k_spin_unlock(&ts_lock, key);
+}
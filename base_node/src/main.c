@@ -3,6 +3,8 @@
 #include "baseBluetooth.h"
 #include "servo.h"
 #include "CLIshell.h"
+#include "hostLink.h"
+#include "telemetry.h"
 /* scheduling parameters */
 #define STACKSIZE 				4096
 #define PRIORITY 				7
@@ -13,4 +15,9 @@ void main_task(void) {
 }
 
 K_THREAD_DEFINE(main_task_id, STACKSIZE, main_task, NULL, NULL, NULL, PRIORITY, 0, 0);
-K_THREAD_DEFINE(bluetooth_receiver0_id, STACKSIZE, bluetooth_receiver0, NULL, NULL, NULL, PRIORITY, 0, 0);
\ No newline at end of file
+K_THREAD_DEFINE(bluetooth_receiver0_id, STACKSIZE, bluetooth_receiver0, NULL, NULL, NULL, PRIORITY, 0, 0);
+#if HOST_LINK_ENABLED
+K_THREAD_DEFINE(host_link_receiver_id, STACKSIZE, host_link_receiver, NULL, NULL, NULL, PRIORITY, 0, 0);
+#else
+K_THREAD_DEFINE(telemetry_sender_id, STACKSIZE, telemetry_sender, NULL, NULL, NULL, PRIORITY, 0, 0);
+#endif
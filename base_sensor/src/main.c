@@ -0,0 +1,143 @@
+/* main.c — Thingy:52 environmental sensor broadcaster */
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+
+#include "envAdvertisement.h"
+
+LOG_MODULE_REGISTER(base_sensor, LOG_LEVEL_INF);
+
+#define SAMPLE_INTERVAL_MS  2000
+
+/*
+ * The compact payload leaves room to spare, so every reading can be
+ * repeated at a relaxed 500 ms interval and still reach a duty-cycled
+ * scanner a few times before the next one replaces it.
+ */
+#define ADV_INTERVAL_MIN    0x0320  /* 500 ms in 0.625 ms units */
+#define ADV_INTERVAL_MAX    0x0370  /* 550 ms */
+
+static const struct device *const hts221 = DEVICE_DT_GET_ONE(st_hts221);
+static const struct device *const lps22hb = DEVICE_DT_GET_ONE(st_lps22hb_press);
+static const struct device *const ccs811 = DEVICE_DT_GET_ONE(ams_ccs811);
+
+static uint8_t mfg_data[ENV_ADV_LEN];
+static struct env_sample latest;
+
+static struct bt_data ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data, sizeof(mfg_data)),
+};
+
+static const struct bt_le_adv_param adv_param =
+    BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_USE_IDENTITY, ADV_INTERVAL_MIN,
+                         ADV_INTERVAL_MAX, NULL);
+
+/* sensor_value to hundredths, without going through float */
+static int32_t to_centi(const struct sensor_value *val)
+{
+    return val->val1 * 100 + val->val2 / 10000;
+}
+
+static int read_channel(const struct device *dev, enum sensor_channel chan, int32_t *centi)
+{
+    struct sensor_value val;
+    int err = sensor_channel_get(dev, chan, &val);
+
+    if (!err) {
+        *centi = to_centi(&val);
+    }
+    return err;
+}
+
+/* Fill in whatever the sensors can give; a failed sensor keeps its previous value */
+static void read_sensors(struct env_sample *sample)
+{
+    int32_t centi;
+
+    if (device_is_ready(hts221) && sensor_sample_fetch(hts221) == 0) {
+        if (read_channel(hts221, SENSOR_CHAN_AMBIENT_TEMP, &centi) == 0) {
+            sample->temp_centi_c = CLAMP(centi, INT16_MIN, INT16_MAX);
+        }
+        if (read_channel(hts221, SENSOR_CHAN_HUMIDITY, &centi) == 0) {
+            sample->humidity_centi_pct = CLAMP(centi, 0, UINT16_MAX);
+        }
+    }
+
+    if (device_is_ready(lps22hb) && sensor_sample_fetch(lps22hb) == 0) {
+        if (read_channel(lps22hb, SENSOR_CHAN_PRESS, &centi) == 0) {
+            sample->pressure_centi_kpa = CLAMP(centi, 0, UINT16_MAX);
+        }
+        if (read_channel(lps22hb, SENSOR_CHAN_AMBIENT_TEMP, &centi) == 0) {
+            sample->lps_temp_centi_c = CLAMP(centi, INT16_MIN, INT16_MAX);
+        }
+    }
+
+    if (device_is_ready(ccs811) && sensor_sample_fetch(ccs811) == 0) {
+        if (read_channel(ccs811, SENSOR_CHAN_CO2, &centi) == 0) {
+            sample->eco2_ppm = CLAMP(centi / 100, 0, UINT16_MAX);
+        }
+        if (read_channel(ccs811, SENSOR_CHAN_VOC, &centi) == 0) {
+            sample->etvoc_ppb = CLAMP(centi / 100, 0, UINT16_MAX);
+        }
+    }
+}
+
+/* shell command: what is currently being broadcast */
+static int cmd_adv(const struct shell *sh, size_t argc, char **argv)
+{
+    shell_print(sh, "seq %u: temp %d hum %u press %u lps temp %d eco2 %u etvoc %u",
+                latest.seq, latest.temp_centi_c, latest.humidity_centi_pct,
+                latest.pressure_centi_kpa, latest.lps_temp_centi_c,
+                latest.eco2_ppm, latest.etvoc_ppb);
+    shell_print(sh, "payload: %u bytes (legacy format %u)",
+                ENV_ADV_LEN, (unsigned int)ENV_ADV_LEGACY_LEN);
+    return 0;
+}
+SHELL_CMD_REGISTER(adv, NULL,
+    "Show the reading currently being broadcast",
+    cmd_adv);
+
+void main(void)
+{
+    int err;
+
+    LOG_INF("Starting sensor broadcaster");
+
+    err = bt_enable(NULL);
+    if (err) {
+        LOG_ERR("Bluetooth init failed (err %d)", err);
+        return;
+    }
+
+    read_sensors(&latest);
+    latest.has_seq = true;
+    env_adv_encode(&latest, mfg_data, sizeof(mfg_data));
+
+    err = bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), NULL, 0);
+    if (err) {
+        LOG_ERR("Advertising failed to start (err %d)", err);
+        return;
+    }
+    LOG_INF("Advertising started");
+
+    while (1) {
+        k_sleep(K_MSEC(SAMPLE_INTERVAL_MS));
+
+        read_sensors(&latest);
+        latest.seq++;
+        env_adv_encode(&latest, mfg_data, sizeof(mfg_data));
+
+        err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad), NULL, 0);
+        if (err) {
+            LOG_WRN("Advertising update failed (err %d)", err);
+        }
+    }
+}
@@ -3,38 +3,88 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-extern struct k_fifo PMODKYPD_fifo;
-extern struct k_fifo ULTRASONIC_fifo;
-extern struct k_fifo MAGNETOMETER_fifo;
-extern struct k_fifo ULTRASONIC_SAMPLE_fifo;
-extern struct k_fifo MAGNETOMETER_SAMPLE_fifo;
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+/*
+ * Bounded sensor -> BLE queues. Nothing here allocates: each queue is a
+ * fixed k_msgq sized at build time. Telemetry queues overwrite their
+ * oldest sample when full; security event queues never overwrite, and
+ * when full refuse (and count) new events rather than stall the
+ * producer. The BLE sender only removes security events once the frame
+ * carrying them has been accepted for transmission.
+ *
+ * Every queue belongs to a lane of the door event bus. Putting an item
+ * posts the lane's bit on door_event_bus so the BLE sender wakes straight
+ * away and always drains the high-priority lane first.
+ */
+enum door_lane {
+	DOOR_LANE_HIGH,	/* proximity, door state, PIN */
+	DOOR_LANE_LOW,	/* telemetry samples */
+	DOOR_LANE_COUNT,
+};
+
+#define DOOR_EVENT_LANE(lane)	BIT(lane)
+#define DOOR_EVENT_ANY		(BIT(DOOR_LANE_COUNT) - 1)
+
+struct door_queue {
+	struct k_msgq *msgq;
+	const char *name;
+	size_t item_size;
+	enum door_lane lane;
+	bool overwrite_oldest;
+	bool refusing;		/* full; reported once until a put succeeds again */
+	uint32_t high_water;
+	atomic_t dropped;
+};
+
+/* Enqueue-to-on-air latency per lane: queueing, TX queue and connection event */
+struct door_lane_stats {
+	uint32_t count;
+	uint64_t total_us;
+	uint32_t max_us;
+};
+
+#define DOOR_QUEUE_MAX_ITEM_SIZE 16
+
+extern struct k_event door_event_bus;
+extern struct door_lane_stats door_lane_latency[DOOR_LANE_COUNT];
+
+extern struct door_queue PMODKYPD_queue;
+extern struct door_queue ULTRASONIC_queue;
+extern struct door_queue MAGNETOMETER_queue;
+extern struct door_queue ULTRASONIC_SAMPLE_queue;
+extern struct door_queue MAGNETOMETER_SAMPLE_queue;
+
+extern struct door_queue *const door_queues[];
+extern const size_t door_queue_count;
+
+int door_queue_put(struct door_queue *queue, const void *item);
+int door_queue_peek(struct door_queue *queue, size_t index, void *item, uint32_t *enqueued_at);
+void door_queue_consume(struct door_queue *queue, size_t count);
+int door_queue_get(struct door_queue *queue, void *item, uint32_t *enqueued_at);
+bool door_lane_pending(enum door_lane lane);
+void door_lane_record(enum door_lane lane, uint32_t count, uint64_t total_us, uint32_t max_us);
 
 struct ultrasonic_data_t {
-	void *fifo_reserved; /* 1st word reserved for use by fifo */
 	bool proximity;
 };
 
 struct pmodkypd_data_t {
-	void *fifo_reserved; /* 1st word reserved for use by fifo */
 	char pin_code[6]; // 5 digits + null terminator
 
 };
 
 struct magnetometer_data_t {
-	void *fifo_reserved; /* 1st word reserved for use by fifo */
 	bool door_opened;
 };
 
 
 struct ultrasonic_sample_data_t {
-	void *fifo_reserved; /* 1st word reserved for use by fifo */
 	int distance_cm;
 };
 
 struct magnetometer_sample_data_t {
-	void *fifo_reserved; /* 1st word reserved for use by fifo */
 	int avg_magnetometer_value;
 };
 #endif // LOCALVARIABLES_H
-
-
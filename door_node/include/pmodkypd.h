@@ -1,18 +1,19 @@
 #ifndef PMODKYPD_H
 #define PMODKYPD_H
 
-extern struct gpio_dt_spec pmodkypd_col1;
-extern struct gpio_dt_spec pmodkypd_col2;
-extern struct gpio_dt_spec pmodkypd_col3;
-extern struct gpio_dt_spec pmodkypd_col4;
-extern struct gpio_dt_spec pmodkypd_row1;
-extern struct gpio_dt_spec pmodkypd_row2;
-extern struct gpio_dt_spec pmodkypd_row3;
-extern struct gpio_dt_spec pmodkypd_row4;
-extern struct gpio_dt_spec led0;
-extern struct gpio_dt_spec led1;
+#include <stdint.h>
 
+/* Key events from the input subsystem to the PIN state machine */
+struct pmodkypd_stats {
+	uint32_t events;
+	uint32_t dropped;
+	uint32_t latency_max_us;	/* input report -> PIN thread */
+	uint64_t latency_total_us;
+	uint32_t pins_dropped;		/* PINs the event queue still refused after PIN_QUEUE_TIMEOUT_MS */
+};
+
+extern struct pmodkypd_stats pmodkypd_stats;
 
 void PmodKypdListener(void);
 
-#endif // PMODKYPD_H
\ No newline at end of file
+#endif // PMODKYPD_H
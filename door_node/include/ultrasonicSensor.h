@@ -1,9 +1,5 @@
 #ifndef ULTRASONICSENSOR_H
 #define ULTRASONICSENSOR_H
 
-// Global declarations of GPIO specifications
-extern struct gpio_dt_spec ultrasonic_trig;   // Trigger pin
-extern struct gpio_dt_spec ultrasonic_echo;  // Echo pin
-
 void UltrasonicSensorRead(void);
-#endif // ULTRASONICSENSOR_H
\ No newline at end of file
+#endif // ULTRASONICSENSOR_H
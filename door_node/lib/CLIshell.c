@@ -0,0 +1,126 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <string.h>
+#include "localVariables.h"
+#include "pmodkypd.h"
+#include "txBluetooth.h"
+
+static int queue_stats(const struct shell *shell, size_t argc, char **argv) {
+    shell_print(shell, "%-26s %5s %5s %5s %7s", "queue", "used", "size", "peak", "dropped");
+
+    for (size_t i = 0; i < door_queue_count; i++) {
+        const struct door_queue *queue = door_queues[i];
+
+        shell_print(shell, "%-26s %5u %5u %5u %7u", queue->name,
+                    k_msgq_num_used_get(queue->msgq), queue->msgq->max_msgs,
+                    queue->high_water, (uint32_t)atomic_get(&queue->dropped));
+    }
+    return 0;
+}
+
+static int lane_latency(const struct shell *shell, size_t argc, char **argv) {
+    static const char *const lane_names[DOOR_LANE_COUNT] = {
+        [DOOR_LANE_HIGH] = "high",
+        [DOOR_LANE_LOW] = "low",
+    };
+
+    shell_print(shell, "%-6s %8s %10s %10s", "lane", "count", "avg_us", "max_us");
+    for (int lane = 0; lane < DOOR_LANE_COUNT; lane++) {
+        const struct door_lane_stats *stats = &door_lane_latency[lane];
+        uint32_t avg_us = stats->count ? (uint32_t)(stats->total_us / stats->count) : 0;
+
+        shell_print(shell, "%-6s %8u %10u %10u", lane_names[lane], stats->count, avg_us, stats->max_us);
+    }
+    return 0;
+}
+
+/* The gpio-kbd-matrix thread carries the device's name */
+static void find_keypad_thread(const struct k_thread *thread, void *user_data) {
+    const struct k_thread **found = user_data;
+    const char *name = k_thread_name_get((k_tid_t)thread);
+
+    if (name && strcmp(name, "pmod_kypd") == 0) {
+        *found = thread;
+    }
+}
+
+static int keypad_stats(const struct shell *shell, size_t argc, char **argv) {
+    static uint64_t last_cycles;
+    static uint64_t last_total;
+    uint32_t avg_us = pmodkypd_stats.events ?
+        (uint32_t)(pmodkypd_stats.latency_total_us / pmodkypd_stats.events) : 0;
+
+    shell_print(shell, "key events: %u, dropped: %u, PINs dropped: %u",
+                pmodkypd_stats.events, pmodkypd_stats.dropped, pmodkypd_stats.pins_dropped);
+    shell_print(shell, "report-to-handler latency: avg %u us, max %u us",
+                avg_us, pmodkypd_stats.latency_max_us);
+
+    // CPU share of the matrix scan thread since the previous call; idle, that is the row polling
+    const struct k_thread *thread = NULL;
+    k_thread_runtime_stats_t scan, all;
+
+    k_thread_foreach(find_keypad_thread, &thread);
+    if (!thread || k_thread_runtime_stats_get((k_tid_t)thread, &scan) != 0 ||
+        k_thread_runtime_stats_all_get(&all) != 0) {
+        shell_print(shell, "Matrix thread not found; use 'kernel threads'");
+        return 0;
+    }
+
+    uint64_t cycles = scan.execution_cycles - last_cycles;
+    uint64_t total = all.execution_cycles - last_total;
+    if (last_total && total) {
+        shell_print(shell, "matrix thread: %u.%02u%% CPU, %u cycles since the last call",
+                    (uint32_t)(cycles * 100 / total), (uint32_t)(cycles * 10000 / total % 100),
+                    (uint32_t)cycles);
+    } else {
+        shell_print(shell, "matrix thread: run again for its CPU share");
+    }
+    last_cycles = scan.execution_cycles;
+    last_total = all.execution_cycles;
+    return 0;
+}
+
+static int link_profile(const struct shell *shell, size_t argc, char **argv) {
+    static const char *const profile_names[CONN_PROFILE_COUNT + 1] = {
+        [CONN_PROFILE_FAST] = "fast",
+        [CONN_PROFILE_POWER_SAVE] = "power-save",
+        [CONN_PROFILE_COUNT] = "disconnected",
+    };
+    struct conn_profile_stats stats;
+
+    get_conn_profile_stats(&stats);
+    shell_print(shell, "profile: %s (%u switches)", profile_names[stats.profile], stats.switches);
+    shell_print(shell, "negotiated: interval %u us, latency %u, timeout %u ms",
+                stats.interval_us, stats.latency, stats.timeout_ms);
+    shell_print(shell, "time fast: %u ms, power-save: %u ms",
+                stats.time_ms[CONN_PROFILE_FAST], stats.time_ms[CONN_PROFILE_POWER_SAVE]);
+    return 0;
+}
+
+static int tx_counters(const struct shell *shell, size_t argc, char **argv) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "acked") == 0) {
+            set_tx_mode(TX_MODE_ACKED);
+        } else if (strcmp(argv[1], "pipelined") == 0) {
+            set_tx_mode(TX_MODE_PIPELINED);
+        } else {
+            shell_error(shell, "Usage: tx [acked|pipelined]");
+            return -EINVAL;
+        }
+    }
+
+    struct tx_stats stats;
+
+    get_tx_stats(&stats);
+    shell_print(shell, "queued: %u, completed: %u, failed: %u, rejected: %u, retried: %u, in flight: %u",
+                stats.queued, stats.completed, stats.failed, stats.rejected, stats.retried,
+                stats.in_flight);
+    shell_print(shell, "rate: %u msgs/s since the previous 'tx'", stats.msgs_per_sec);
+    return 0;
+}
+
+SHELL_CMD_REGISTER(queues, NULL, "Sensor queue high-water marks and drop counts", queue_stats);
+SHELL_CMD_REGISTER(latency, NULL, "Enqueue-to-transmit latency per event bus lane", lane_latency);
+SHELL_CMD_REGISTER(keypad, NULL, "Keypad event counts and latency", keypad_stats);
+SHELL_CMD_REGISTER(tx, NULL, "BLE write counters and rate; optionally switch mode: tx [acked|pipelined]", tx_counters);
+SHELL_CMD_REGISTER(link, NULL, "Connection profile, negotiated interval and time per mode", link_profile);
@@ -1,8 +1,43 @@
 #include "doorBluetooth.h"
 #include "txBluetooth.h"
 #include "localVariables.h"
+#include "msgProtocol.h"
 #include <zephyr/kernel.h>
 
+/* How long telemetry waits for company before it is sent on its own */
+#define TELEMETRY_BATCH_MS  50
+#define LINK_RETRY_MS       100
+
+/* Records that fit in the largest frame */
+#define FRAME_MAX_RECORDS   ((TX_MSG_MAX_LEN - MSG_HEADER_LEN) / (MSG_RECORD_HEADER_LEN + 1))
+
+/* When each record in the frame was queued, for per-lane latency */
+struct frame_stamps {
+    size_t count;
+    enum door_lane lane[FRAME_MAX_RECORDS];
+    uint32_t enqueued_at[FRAME_MAX_RECORDS];
+};
+
+/*
+ * A queued frame's records, folded per lane as ages at queued_at. The
+ * TX completion adds the time the frame then spent in the TX queue and
+ * waiting for its connection event. Frames still outstanding never
+ * exceed the TX queue, the writes in flight and the one pending write.
+ */
+struct frame_lanes {
+    uint32_t queued_at;
+    struct {
+        uint32_t count;
+        uint32_t age_max_us;
+        uint64_t age_total_us;
+    } lane[DOOR_LANE_COUNT];
+};
+
+#define SENT_FRAMES 16
+BUILD_ASSERT(SENT_FRAMES >= TX_QUEUE_LEN + TX_MAX_IN_FLIGHT + 1);
+
+static struct frame_lanes sent_frames[SENT_FRAMES];
+
 struct bt_uuid_128 tx_device_service_uuid = BT_UUID_INIT_128(
     0xaa, 0xbb, 0xcc, 0xdd,
     0xee, 0xff,
@@ -21,55 +56,172 @@ struct bt_uuid_128 tx_device_char_uuid = BT_UUID_INIT_128(
 
 char device_name[] = "base_node";
 
+#define SEND_RETRY_MS 5
+
+static bool frame_has_room(const struct msg_writer *writer)
+{
+    return msg_writer_space(writer) >= MSG_MAX_RECORD_LEN;
+}
+
+static uint32_t *stamp_slot(struct frame_stamps *stamps, enum door_lane lane)
+{
+    stamps->lane[stamps->count] = lane;
+    return &stamps->enqueued_at[stamps->count];
+}
+
+static void frame_lanes_fold(struct frame_lanes *lanes, const struct frame_stamps *stamps)
+{
+    *lanes = (struct frame_lanes) { .queued_at = k_cycle_get_32() };
+
+    for (size_t i = 0; i < stamps->count; i++) {
+        uint32_t age_us = k_cyc_to_us_floor32(lanes->queued_at - stamps->enqueued_at[i]);
+
+        lanes->lane[stamps->lane[i]].count++;
+        lanes->lane[stamps->lane[i]].age_total_us += age_us;
+        lanes->lane[stamps->lane[i]].age_max_us = MAX(lanes->lane[stamps->lane[i]].age_max_us, age_us);
+    }
+}
+
+/* TX completion: the frame tagged tag is on air */
+static void frame_sent(uint32_t tag)
+{
+    const struct frame_lanes *lanes = &sent_frames[tag % SENT_FRAMES];
+    uint32_t wait_us = k_cyc_to_us_floor32(k_cycle_get_32() - lanes->queued_at);
+
+    for (int lane = 0; lane < DOOR_LANE_COUNT; lane++) {
+        uint32_t count = lanes->lane[lane].count;
+
+        if (count) {
+            door_lane_record(lane, count,
+                             lanes->lane[lane].age_total_us + (uint64_t)count * wait_us,
+                             lanes->lane[lane].age_max_us + wait_us);
+        }
+    }
+}
+
+/* Queue a frame, waiting out backpressure from the BLE sender; other errors are returned */
+static int send_frame(const uint8_t *frame, uint16_t len, uint32_t tag)
+{
+    int err;
+
+    while ((err = send_msg(frame, len, tag)) == -ENOBUFS) {
+        k_sleep(K_MSEC(SEND_RETRY_MS));
+    }
+    return err;
+}
+
 void bluetooth_sender0(void)
 {
+    set_tx_sent_cb(frame_sent);
     bluetooth_scanner();
 
-    while (!discovered_handle) {
-        printk("Waiting for discovery...\n");
-        k_sleep(K_SECONDS(5));
-    }
+    // Bonded reconnects resolve the handle from cache; the first pairing takes a few seconds
+    wait_for_discovery(K_FOREVER);
+
+    uint32_t frame_tag = 0;
 
     while (1)
     {
-        struct pmodkypd_data_t *pmodkypd_data = k_fifo_get(&PMODKYPD_fifo, K_NO_WAIT);
-        if (pmodkypd_data != NULL) {
-            char msg[32];
-            snprintf(msg, sizeof(msg), "pin,%s", pmodkypd_data->pin_code);
-            send_msg(msg);
-            k_free(pmodkypd_data);
+        uint32_t events = k_event_wait(&door_event_bus, DOOR_EVENT_ANY, false, K_FOREVER);
+        if (!(events & DOOR_EVENT_LANE(DOOR_LANE_HIGH))) {
+            // Telemetry only: let a few more samples (or an urgent event) join this frame.
+            // An urgent event that ends the wait goes in this frame, so it counts below
+            events |= k_event_wait(&door_event_bus, DOOR_EVENT_LANE(DOOR_LANE_HIGH), false,
+                                   K_MSEC(TELEMETRY_BATCH_MS));
+        }
+        k_event_clear(&door_event_bus, DOOR_EVENT_ANY);
+
+        // Proximity, door and PIN events want the short connection interval
+        if (events & DOOR_EVENT_LANE(DOOR_LANE_HIGH)) {
+            set_conn_profile(CONN_PROFILE_FAST);
+        }
+
+        uint16_t payload_max = get_tx_payload_max();
+        if (!payload_max) {
+            // Link is down; the queues hold (or overwrite) until it is back
+            k_sleep(K_MSEC(LINK_RETRY_MS));
+            k_event_post(&door_event_bus, DOOR_EVENT_ANY);
+            continue;
+        }
+
+        uint8_t frame[TX_MSG_MAX_LEN];
+        struct msg_writer writer;
+        struct frame_stamps stamps = { 0 };
+
+        msg_writer_init(&writer, frame, MIN(sizeof(frame), payload_max));
+
+        // High-priority lane first: proximity, door state, PIN. These are only
+        // peeked at here and stay queued until the frame has been accepted
+        size_t ultrasonic_taken = 0;
+        struct ultrasonic_data_t ultrasonic_data;
+        while (frame_has_room(&writer) &&
+               door_queue_peek(&ULTRASONIC_queue, ultrasonic_taken, &ultrasonic_data,
+                               stamp_slot(&stamps, DOOR_LANE_HIGH)) == 0) {
+            msg_put_u8(&writer, MSG_TYPE_PROXIMITY, ultrasonic_data.proximity);
+            ultrasonic_taken++;
+            stamps.count++;
         }
-        
-
-        struct ultrasonic_data_t *ultrasonic_data = k_fifo_get(&ULTRASONIC_fifo, K_NO_WAIT);
-        if (ultrasonic_data != NULL) {
-            char msg[32];
-            snprintf(msg, sizeof(msg), "ultrasonic,%c", ultrasonic_data->proximity ? '1' : '0');
-            send_msg(msg);
-            k_free(ultrasonic_data);
+
+        size_t magnetometer_taken = 0;
+        struct magnetometer_data_t magnetometer_data;
+        while (frame_has_room(&writer) &&
+               door_queue_peek(&MAGNETOMETER_queue, magnetometer_taken, &magnetometer_data,
+                               stamp_slot(&stamps, DOOR_LANE_HIGH)) == 0) {
+            msg_put_u8(&writer, MSG_TYPE_DOOR_OPEN, magnetometer_data.door_opened);
+            magnetometer_taken++;
+            stamps.count++;
         }
 
-        struct magnetometer_data_t *magnetometer_data = k_fifo_get(&MAGNETOMETER_fifo, K_NO_WAIT);
-        if (magnetometer_data != NULL) {
-            char msg[32];
-            snprintf(msg, sizeof(msg), "magnetometer,%c", magnetometer_data->door_opened ? '1' : '0');
-            send_msg(msg);
-            k_free(magnetometer_data);
+        size_t pmodkypd_taken = 0;
+        struct pmodkypd_data_t pmodkypd_data;
+        while (frame_has_room(&writer) &&
+               door_queue_peek(&PMODKYPD_queue, pmodkypd_taken, &pmodkypd_data,
+                               stamp_slot(&stamps, DOOR_LANE_HIGH)) == 0) {
+            msg_put_bytes(&writer, MSG_TYPE_PIN, pmodkypd_data.pin_code, MSG_PIN_LEN);
+            pmodkypd_taken++;
+            stamps.count++;
         }
-        struct ultrasonic_sample_data_t *ultrasonic_sample_data = k_fifo_get(&ULTRASONIC_SAMPLE_fifo, K_NO_WAIT);
-        if (ultrasonic_sample_data != NULL) {
-            char msg[32];
-            snprintf(msg, sizeof(msg), "ultrasonic_s,%d", ultrasonic_sample_data->distance_cm);
-            send_msg(msg);
-            k_free(ultrasonic_sample_data);
+
+        // Low-priority lane: telemetry fills whatever room is left
+        struct ultrasonic_sample_data_t ultrasonic_sample_data;
+        while (frame_has_room(&writer) &&
+               door_queue_get(&ULTRASONIC_SAMPLE_queue, &ultrasonic_sample_data, stamp_slot(&stamps, DOOR_LANE_LOW)) == 0) {
+            msg_put_s16(&writer, MSG_TYPE_ULTRASONIC_SAMPLE, ultrasonic_sample_data.distance_cm);
+            stamps.count++;
         }
-        struct magnetometer_sample_data_t *magnetometer_sample_data = k_fifo_get(&MAGNETOMETER_SAMPLE_fifo, K_NO_WAIT);
-        if (magnetometer_sample_data != NULL) {
-            char msg[32];
-            snprintf(msg, sizeof(msg), "magnetometer_s,%d", magnetometer_sample_data->avg_magnetometer_value);
-            send_msg(msg);
-            k_free(magnetometer_sample_data);
+
+        struct magnetometer_sample_data_t magnetometer_sample_data;
+        while (frame_has_room(&writer) &&
+               door_queue_get(&MAGNETOMETER_SAMPLE_queue, &magnetometer_sample_data, stamp_slot(&stamps, DOOR_LANE_LOW)) == 0) {
+            msg_put_s16(&writer, MSG_TYPE_MAGNETOMETER_SAMPLE, magnetometer_sample_data.avg_magnetometer_value);
+            stamps.count++;
+        }
+
+        if (!msg_writer_empty(&writer)) {
+            // Filled before queueing: the completion may run before send_frame returns
+            frame_lanes_fold(&sent_frames[frame_tag % SENT_FRAMES], &stamps);
+            int err = send_frame(frame, writer.len, frame_tag);
+            if (err) {
+                // Link lost or MTU changed under us: the events are still queued and
+                // go into a fresh frame once the link is back; telemetry is let go
+                printk("Frame not sent (err %d), %u events kept\n", err,
+                       (unsigned int)(ultrasonic_taken + magnetometer_taken + pmodkypd_taken));
+                k_sleep(K_MSEC(LINK_RETRY_MS));
+                k_event_post(&door_event_bus, DOOR_EVENT_ANY);
+                continue;
+            }
+
+            door_queue_consume(&ULTRASONIC_queue, ultrasonic_taken);
+            door_queue_consume(&MAGNETOMETER_queue, magnetometer_taken);
+            door_queue_consume(&PMODKYPD_queue, pmodkypd_taken);
+            frame_tag++;
+        }
+
+        // Frame was full: come straight back for the rest
+        if (door_lane_pending(DOOR_LANE_HIGH)) {
+            k_event_post(&door_event_bus, DOOR_EVENT_LANE(DOOR_LANE_HIGH));
+        } else if (door_lane_pending(DOOR_LANE_LOW)) {
+            k_event_post(&door_event_bus, DOOR_EVENT_LANE(DOOR_LANE_LOW));
         }
-        k_sleep(K_MSEC(50));
     }
-}
\ No newline at end of file
+}
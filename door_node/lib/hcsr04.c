@@ -0,0 +1,149 @@
+#define DT_DRV_COMPAT slarm_hc_sr04
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/sys/printk.h>
+
+#define HCSR04_US_PER_CM        58
+#define HCSR04_TRIGGER_US       10
+/* Time between the trigger pulse and the echo going high */
+#define HCSR04_ECHO_DELAY_US    1000
+
+struct hcsr04_config {
+    struct gpio_dt_spec trig;
+    struct gpio_dt_spec echo;
+    uint32_t timeout_us;
+};
+
+struct hcsr04_data {
+    const struct device *dev;
+    struct gpio_callback echo_cb;
+    struct k_sem echo_done;
+    uint32_t rise_cycles;
+    uint32_t pulse_cycles;
+    bool rise_seen;
+    uint32_t distance_mm;
+};
+
+/* Timestamp both echo edges from the GPIO interrupt; the fetching thread sleeps meanwhile */
+static void hcsr04_echo_handler(const struct device *port, struct gpio_callback *cb,
+                                gpio_port_pins_t pins)
+{
+    struct hcsr04_data *data = CONTAINER_OF(cb, struct hcsr04_data, echo_cb);
+    const struct hcsr04_config *config = data->dev->config;
+    uint32_t now = k_cycle_get_32();
+
+    if (gpio_pin_get_dt(&config->echo)) {
+        data->rise_cycles = now;
+        data->rise_seen = true;
+    } else if (data->rise_seen) {
+        data->pulse_cycles = now - data->rise_cycles;
+        k_sem_give(&data->echo_done);
+    }
+}
+
+static int hcsr04_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    const struct hcsr04_config *config = dev->config;
+    struct hcsr04_data *data = dev->data;
+
+    if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_DISTANCE) {
+        return -ENOTSUP;
+    }
+
+    // Previous echo still running (out-of-range pulses last ~38 ms)
+    if (gpio_pin_get_dt(&config->echo)) {
+        return -EBUSY;
+    }
+
+    data->rise_seen = false;
+    k_sem_reset(&data->echo_done);
+
+    int ret = gpio_pin_interrupt_configure_dt(&config->echo, GPIO_INT_EDGE_BOTH);
+    if (ret < 0) {
+        return ret;
+    }
+
+    gpio_pin_set_dt(&config->trig, 1);
+    k_busy_wait(HCSR04_TRIGGER_US);
+    gpio_pin_set_dt(&config->trig, 0);
+
+    ret = k_sem_take(&data->echo_done, K_USEC(config->timeout_us));
+    gpio_pin_interrupt_configure_dt(&config->echo, GPIO_INT_DISABLE);
+    if (ret < 0) {
+        return -ETIMEDOUT;
+    }
+
+    uint32_t pulse_us = k_cyc_to_us_floor32(data->pulse_cycles);
+    data->distance_mm = pulse_us * 10U / HCSR04_US_PER_CM;
+
+    return 0;
+}
+
+static int hcsr04_channel_get(const struct device *dev, enum sensor_channel chan,
+                              struct sensor_value *val)
+{
+    struct hcsr04_data *data = dev->data;
+
+    if (chan != SENSOR_CHAN_DISTANCE) {
+        return -ENOTSUP;
+    }
+
+    // SENSOR_CHAN_DISTANCE is in metres
+    val->val1 = data->distance_mm / 1000U;
+    val->val2 = (data->distance_mm % 1000U) * 1000U;
+
+    return 0;
+}
+
+static const struct sensor_driver_api hcsr04_api = {
+    .sample_fetch = hcsr04_sample_fetch,
+    .channel_get = hcsr04_channel_get,
+};
+
+static int hcsr04_init(const struct device *dev)
+{
+    const struct hcsr04_config *config = dev->config;
+    struct hcsr04_data *data = dev->data;
+    int ret;
+
+    if (!gpio_is_ready_dt(&config->trig) || !gpio_is_ready_dt(&config->echo)) {
+        printk("HC-SR04 GPIOs not ready\n");
+        return -ENODEV;
+    }
+
+    ret = gpio_pin_configure_dt(&config->trig, GPIO_OUTPUT_INACTIVE);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = gpio_pin_configure_dt(&config->echo, GPIO_INPUT);
+    if (ret < 0) {
+        return ret;
+    }
+
+    data->dev = dev;
+    k_sem_init(&data->echo_done, 0, 1);
+    gpio_init_callback(&data->echo_cb, hcsr04_echo_handler, BIT(config->echo.pin));
+
+    return gpio_add_callback_dt(&config->echo, &data->echo_cb);
+}
+
+#define HCSR04_DEFINE(inst)                                                     \
+    static struct hcsr04_data hcsr04_data_##inst;                               \
+                                                                                \
+    static const struct hcsr04_config hcsr04_config_##inst = {                  \
+        .trig = GPIO_DT_SPEC_INST_GET(inst, trig_gpios),                        \
+        .echo = GPIO_DT_SPEC_INST_GET(inst, echo_gpios),                        \
+        .timeout_us = DT_INST_PROP(inst, max_range_cm) * HCSR04_US_PER_CM +     \
+                      HCSR04_ECHO_DELAY_US,                                     \
+    };                                                                          \
+                                                                                \
+    SENSOR_DEVICE_DT_INST_DEFINE(inst, hcsr04_init, NULL,                       \
+                                 &hcsr04_data_##inst, &hcsr04_config_##inst,    \
+                                 POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,      \
+                                 &hcsr04_api);
+
+DT_INST_FOREACH_STATUS_OKAY(HCSR04_DEFINE)
@@ -2,17 +2,45 @@
 #include <zephyr/device.h>
 #include <zephyr/drivers/sensor.h>
 #include <lis3mdl.h>
-#include <math.h>
-#include <string.h>
+#include <stdlib.h>
 #include "localVariables.h"
 #include <stdbool.h>
 
-#define MAGNETOMETER_THRESHOLD 2.5
-#define MAGNETOMETER_SAMPLE_INTERVAL_MS 100
-#define MAGNETOMETER_PRINT_INTERVAL_COUNT (1000 / MAGNETOMETER_SAMPLE_INTERVAL_MS)  // 10
+/*
+ * Door detection runs in integer milligauss with hysteresis around the
+ * old 2.5 gauss threshold, so a field hovering at the edge cannot make
+ * the door flap between open and closed.
+ */
+#define MAGNETOMETER_OPEN_BELOW_MG      2400
+#define MAGNETOMETER_CLOSED_ABOVE_MG    2600
 
-static double compute_avg_magnitude(double x, double y, double z) {
-    return (fabs(x) + fabs(y) + fabs(z)) / 3.0;
+/*
+ * The chip runs at CONFIG_LIS3MDL_ODR (2.5 Hz, the slowest rate at or
+ * above the old 2 Hz poll), so each reading is one wakeup and every
+ * reading is published as a telemetry sample.
+ */
+/* Fallback if a data-ready interrupt is ever missed */
+#define MAGNETOMETER_DRDY_TIMEOUT       K_SECONDS(1)
+
+K_SEM_DEFINE(magnetometer_drdy, 0, 1);
+
+static void magnetometer_drdy_handler(const struct device *dev, const struct sensor_trigger *trig)
+{
+    k_sem_give(&magnetometer_drdy);
+}
+
+static int32_t sensor_value_to_milli(const struct sensor_value *val)
+{
+    return val->val1 * 1000 + val->val2 / 1000;
+}
+
+static int32_t compute_avg_magnitude_mg(const struct sensor_value xyz[3])
+{
+    int32_t sum = abs(sensor_value_to_milli(&xyz[0])) +
+                  abs(sensor_value_to_milli(&xyz[1])) +
+                  abs(sensor_value_to_milli(&xyz[2]));
+
+    return sum / 3;
 }
 
 void MagnetometerSensorRead(void)
@@ -23,54 +51,55 @@ void MagnetometerSensorRead(void)
         return;
     }
 
+    struct sensor_trigger drdy_trigger = {
+        .type = SENSOR_TRIG_DATA_READY,
+        .chan = SENSOR_CHAN_MAGN_XYZ,
+    };
+    if (sensor_trigger_set(dev, &drdy_trigger, magnetometer_drdy_handler) < 0) {
+        printk("Failed to set LIS3MDL data-ready trigger\n");
+    }
+
     bool was_open = false;
     printk("Starting Magnetometer Sensor Read\n");
     while (1) {
+        // Sleep until the chip has a new sample at its own output data rate
+        k_sem_take(&magnetometer_drdy, MAGNETOMETER_DRDY_TIMEOUT);
+
         if (sensor_sample_fetch(dev) < 0) {
             printk("Failed to fetch LIS3MDL sample\n");
-            k_sleep(K_MSEC(MAGNETOMETER_SAMPLE_INTERVAL_MS));
             continue;
         }
 
-        struct sensor_value x_val, y_val, z_val;
-        if (sensor_channel_get(dev, SENSOR_CHAN_MAGN_X, &x_val) < 0 ||
-            sensor_channel_get(dev, SENSOR_CHAN_MAGN_Y, &y_val) < 0 ||
-            sensor_channel_get(dev, SENSOR_CHAN_MAGN_Z, &z_val) < 0) {
+        struct sensor_value xyz[3];
+        if (sensor_channel_get(dev, SENSOR_CHAN_MAGN_XYZ, xyz) < 0) {
             printk("Failed to read LIS3MDL axes\n");
-            k_sleep(K_MSEC(MAGNETOMETER_SAMPLE_INTERVAL_MS));
             continue;
         }
 
-        double x = sensor_value_to_double(&x_val);
-        double y = sensor_value_to_double(&y_val);
-        double z = sensor_value_to_double(&z_val);
+        int32_t avg_mg = compute_avg_magnitude_mg(xyz);
 
-        double avg = compute_avg_magnitude(x, y, z);
-        bool door_open = avg < MAGNETOMETER_THRESHOLD;
+        bool door_open = was_open;
+        if (avg_mg < MAGNETOMETER_OPEN_BELOW_MG) {
+            door_open = true;
+        } else if (avg_mg > MAGNETOMETER_CLOSED_ABOVE_MG) {
+            door_open = false;
+        }
 
-        
-        // If door state changes, send to FIFO
+        // If door state changes, send to the event queue
         if (door_open != was_open) {
-            was_open = door_open;
-            printk("Door state changed: %s\n", door_open ? "Open" : "Closed");
-
-            struct magnetometer_data_t *data = k_malloc(sizeof(struct magnetometer_data_t));
-            if (!data) {
-                printk("Failed to allocate magnetometer_data_t\n");
-                continue;
+            struct magnetometer_data_t data = {
+                .door_opened = door_open,
+            };
+            // A refused change is offered again with the next sample
+            if (door_queue_put(&MAGNETOMETER_queue, &data) == 0) {
+                was_open = door_open;
+                printk("Door state changed: %s\n", door_open ? "Open" : "Closed");
             }
-
-            data->door_opened = door_open;
-            k_fifo_put(&MAGNETOMETER_fifo, data);
-        }
-        struct magnetometer_sample_data_t *sample_data = k_malloc(sizeof(struct magnetometer_sample_data_t));
-        if (!sample_data) {
-            printk("Failed to allocate magnetometer_sample_data_t\n");
-            continue;
         }
-        sample_data->avg_magnetometer_value = (int)(avg*100); // Store as integer percentage
-        k_fifo_put(&MAGNETOMETER_SAMPLE_fifo, sample_data);
 
-        k_sleep(K_MSEC(500));
+        struct magnetometer_sample_data_t sample_data = {
+            .avg_magnetometer_value = avg_mg / 10, // centigauss
+        };
+        door_queue_put(&MAGNETOMETER_SAMPLE_queue, &sample_data);
     }
 }
@@ -1,8 +1,148 @@
 #include "localVariables.h"
 #include <zephyr/kernel.h>
+#include <string.h>
 
-K_FIFO_DEFINE(PMODKYPD_fifo);
-K_FIFO_DEFINE(ULTRASONIC_fifo);
-K_FIFO_DEFINE(MAGNETOMETER_fifo);
-K_FIFO_DEFINE(ULTRASONIC_SAMPLE_fifo);
-K_FIFO_DEFINE(MAGNETOMETER_SAMPLE_fifo);
\ No newline at end of file
+/* What actually sits in each k_msgq: the item plus when it was queued */
+struct door_queue_slot {
+    uint32_t enqueued_at;
+    uint8_t item[DOOR_QUEUE_MAX_ITEM_SIZE];
+};
+
+#define DOOR_QUEUE_SLOT_SIZE(_type) \
+    (offsetof(struct door_queue_slot, item) + sizeof(_type))
+
+#define DOOR_QUEUE_DEFINE(_name, _type, _depth, _lane, _overwrite)            \
+    BUILD_ASSERT(sizeof(_type) <= DOOR_QUEUE_MAX_ITEM_SIZE);                  \
+    K_MSGQ_DEFINE(_name##_msgq, DOOR_QUEUE_SLOT_SIZE(_type), _depth, 4);      \
+    struct door_queue _name = {                                               \
+        .msgq = &_name##_msgq,                                                \
+        .name = #_name,                                                       \
+        .item_size = sizeof(_type),                                           \
+        .lane = _lane,                                                        \
+        .overwrite_oldest = _overwrite,                                       \
+        .dropped = ATOMIC_INIT(0),                                            \
+    }
+
+K_EVENT_DEFINE(door_event_bus);
+struct door_lane_stats door_lane_latency[DOOR_LANE_COUNT];
+
+/* Security events: never overwritten; a full queue refuses new ones */
+DOOR_QUEUE_DEFINE(PMODKYPD_queue, struct pmodkypd_data_t, 4, DOOR_LANE_HIGH, false);
+DOOR_QUEUE_DEFINE(ULTRASONIC_queue, struct ultrasonic_data_t, 8, DOOR_LANE_HIGH, false);
+DOOR_QUEUE_DEFINE(MAGNETOMETER_queue, struct magnetometer_data_t, 8, DOOR_LANE_HIGH, false);
+
+/* Telemetry: only the newest samples matter */
+DOOR_QUEUE_DEFINE(ULTRASONIC_SAMPLE_queue, struct ultrasonic_sample_data_t, 8, DOOR_LANE_LOW, true);
+DOOR_QUEUE_DEFINE(MAGNETOMETER_SAMPLE_queue, struct magnetometer_sample_data_t, 8, DOOR_LANE_LOW, true);
+
+struct door_queue *const door_queues[] = {
+    &PMODKYPD_queue,
+    &ULTRASONIC_queue,
+    &MAGNETOMETER_queue,
+    &ULTRASONIC_SAMPLE_queue,
+    &MAGNETOMETER_SAMPLE_queue,
+};
+const size_t door_queue_count = ARRAY_SIZE(door_queues);
+
+/**
+ * @brief Queue an item without allocating and wake the BLE sender
+ *
+ * Telemetry queues discard their oldest entry to make room. Event queues
+ * never block the producer: when full (the link has been down a while)
+ * the item is refused with -ENOBUFS and counted as dropped, and state
+ * producers try again with their next reading.
+ */
+int door_queue_put(struct door_queue *queue, const void *item)
+{
+    struct door_queue_slot slot;
+
+    slot.enqueued_at = k_cycle_get_32();
+    memcpy(slot.item, item, queue->item_size);
+
+    if (queue->overwrite_oldest) {
+        struct door_queue_slot discard;
+
+        while (k_msgq_put(queue->msgq, &slot, K_NO_WAIT) != 0) {
+            if (k_msgq_get(queue->msgq, &discard, K_NO_WAIT) == 0) {
+                atomic_inc(&queue->dropped);
+            }
+        }
+    } else if (k_msgq_put(queue->msgq, &slot, K_NO_WAIT) != 0) {
+        atomic_inc(&queue->dropped);
+        if (!queue->refusing) {
+            printk("%s full, refusing events until the BLE sender drains it\n", queue->name);
+            queue->refusing = true;
+        }
+        return -ENOBUFS;
+    }
+    queue->refusing = false;
+
+    uint32_t used = k_msgq_num_used_get(queue->msgq);
+    if (used > queue->high_water) {
+        queue->high_water = used;
+    }
+
+    k_event_post(&door_event_bus, DOOR_EVENT_LANE(queue->lane));
+    return 0;
+}
+
+/* Read the item index places from the head without removing it */
+int door_queue_peek(struct door_queue *queue, size_t index, void *item, uint32_t *enqueued_at)
+{
+    struct door_queue_slot slot;
+
+    int ret = k_msgq_peek_at(queue->msgq, &slot, index);
+    if (ret != 0) {
+        return ret;
+    }
+
+    memcpy(item, slot.item, queue->item_size);
+    *enqueued_at = slot.enqueued_at;
+    return 0;
+}
+
+/* Remove count items from the head, once the frame carrying them was accepted */
+void door_queue_consume(struct door_queue *queue, size_t count)
+{
+    struct door_queue_slot slot;
+
+    while (count-- > 0 && k_msgq_get(queue->msgq, &slot, K_NO_WAIT) == 0) {
+    }
+}
+
+int door_queue_get(struct door_queue *queue, void *item, uint32_t *enqueued_at)
+{
+    struct door_queue_slot slot;
+
+    int ret = k_msgq_get(queue->msgq, &slot, K_NO_WAIT);
+    if (ret != 0) {
+        return ret;
+    }
+
+    memcpy(item, slot.item, queue->item_size);
+    *enqueued_at = slot.enqueued_at;
+    return 0;
+}
+
+bool door_lane_pending(enum door_lane lane)
+{
+    for (size_t i = 0; i < door_queue_count; i++) {
+        if (door_queues[i]->lane == lane && k_msgq_num_used_get(door_queues[i]->msgq) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Called once an item has been handed to the BLE stack */
+/* Add count records whose latencies sum to total_us; called from the TX completion path only */
+void door_lane_record(enum door_lane lane, uint32_t count, uint64_t total_us, uint32_t max_us)
+{
+    struct door_lane_stats *stats = &door_lane_latency[lane];
+
+    stats->count += count;
+    stats->total_us += total_us;
+    if (max_us > stats->max_us) {
+        stats->max_us = max_us;
+    }
+}
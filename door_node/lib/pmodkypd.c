@@ -1,81 +1,142 @@
 #include "pmodkypd.h"
 #include <localVariables.h>
+#include "txBluetooth.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
+#include <zephyr/input/input.h>
 #include <zephyr/kernel.h>
 #include <zephyr/sys/printk.h>
+#include <string.h>
 
-#define PMODKYPD_COL1_NODE  DT_ALIAS(pmodkypdcol1)
-#define PMODKYPD_COL2_NODE  DT_ALIAS(pmodkypdcol2)
-#define PMODKYPD_COL3_NODE  DT_ALIAS(pmodkypdcol3)
-#define PMODKYPD_COL4_NODE  DT_ALIAS(pmodkypdcol4)
-#define PMODKYPD_ROW1_NODE  DT_ALIAS(pmodkypdrow1)
-#define PMODKYPD_ROW2_NODE  DT_ALIAS(pmodkypdrow2)
-#define PMODKYPD_ROW3_NODE  DT_ALIAS(pmodkypdrow3)
-#define PMODKYPD_ROW4_NODE  DT_ALIAS(pmodkypdrow4)
+#define PMODKYPD_NODE       DT_NODELABEL(pmod_kypd)
 #define PMODKYPD_LED0_NODE  DT_ALIAS(led0)
 
+#define KEY_QUEUE_LEN       16
+#define BLINK_START_MS      150
+#define BLINK_DIGIT_MS      50
+#define BLINK_PIN_DONE_MS   3000
+#define BLINK_ERROR_MS      100
+#define BLINK_ERROR_COUNT   10      /* toggles: five quick flashes */
+
+/* A full PIN queue is retried this long before the PIN is given up on */
+#define PIN_QUEUE_TIMEOUT_MS    500
+#define PIN_QUEUE_RETRY_MS      20
+
 struct gpio_dt_spec led0 = GPIO_DT_SPEC_GET(PMODKYPD_LED0_NODE, gpios);
 
+struct pmodkypd_stats pmodkypd_stats;
+
+struct key_event {
+    uint8_t row;
+    uint8_t col;
+    uint32_t reported_at;
+};
+
+K_MSGQ_DEFINE(key_msgq, sizeof(struct key_event), KEY_QUEUE_LEN, 4);
+
+const char *keymap[4][4] = {
+    {"1", "2", "3", "A"},
+    {"4", "5", "6", "B"},
+    {"7", "8", "9", "C"},
+    {"0", "F", "E", "D"},
+};
+
+/*
+ * The gpio-kbd-matrix driver scans and debounces the keypad and reports
+ * each key as ABS_X (column), ABS_Y (row) and a synced BTN_TOUCH. Only
+ * presses are queued; the PIN logic never blocks the scanner.
+ */
+static void pmodkypd_input_cb(struct input_event *evt, void *user_data)
+{
+    static struct key_event pending;
+
+    switch (evt->code) {
+    case INPUT_ABS_X:
+        pending.col = evt->value;
+        break;
+    case INPUT_ABS_Y:
+        pending.row = evt->value;
+        break;
+    case INPUT_BTN_TOUCH:
+        if (evt->sync && evt->value) {
+            pending.reported_at = k_cycle_get_32();
+            if (k_msgq_put(&key_msgq, &pending, K_NO_WAIT) != 0) {
+                pmodkypd_stats.dropped++;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+INPUT_CALLBACK_DEFINE(DEVICE_DT_GET(PMODKYPD_NODE), pmodkypd_input_cb, NULL);
 
+static void led_off_handler(struct k_work *work)
+{
+    gpio_pin_set_dt(&led0, 0);
+}
 
+static K_WORK_DELAYABLE_DEFINE(led_off_work, led_off_handler);
 
-static struct gpio_dt_spec cols[4];
-static struct gpio_dt_spec rows[4];
+static int led_error_toggles;
 
+static void led_error_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(led_error_work, led_error_handler);
 
-struct gpio_dt_spec pmodkypd_col1 = GPIO_DT_SPEC_GET(PMODKYPD_COL1_NODE, gpios);
-struct gpio_dt_spec pmodkypd_col2 = GPIO_DT_SPEC_GET(PMODKYPD_COL2_NODE, gpios);
-struct gpio_dt_spec pmodkypd_col3 = GPIO_DT_SPEC_GET(PMODKYPD_COL3_NODE, gpios);
-struct gpio_dt_spec pmodkypd_col4 = GPIO_DT_SPEC_GET(PMODKYPD_COL4_NODE, gpios);
-struct gpio_dt_spec pmodkypd_row1 = GPIO_DT_SPEC_GET(PMODKYPD_ROW1_NODE, gpios);
-struct gpio_dt_spec pmodkypd_row2 = GPIO_DT_SPEC_GET(PMODKYPD_ROW2_NODE, gpios);
-struct gpio_dt_spec pmodkypd_row3 = GPIO_DT_SPEC_GET(PMODKYPD_ROW3_NODE, gpios);
-struct gpio_dt_spec pmodkypd_row4 = GPIO_DT_SPEC_GET(PMODKYPD_ROW4_NODE, gpios);
+static void led_error_handler(struct k_work *work)
+{
+    gpio_pin_toggle_dt(&led0);
+    if (--led_error_toggles > 0) {
+        k_work_reschedule(&led_error_work, K_MSEC(BLINK_ERROR_MS));
+    }
+}
 
+/* Light LED0 for a while without holding up key handling */
+static void led_blink(uint32_t duration_ms)
+{
+    gpio_pin_set_dt(&led0, 1);
+    k_work_reschedule(&led_off_work, K_MSEC(duration_ms));
+}
+
+/* Flash LED0 quickly to tell the user their PIN was not sent */
+static void led_error(void)
+{
+    k_work_cancel_delayable(&led_off_work);
+    gpio_pin_set_dt(&led0, 0);
+    led_error_toggles = BLINK_ERROR_COUNT;
+    k_work_reschedule(&led_error_work, K_NO_WAIT);
+}
+
+/*
+ * A PIN is a security event and must not be lost to a momentarily full
+ * queue. This runs on the keypad thread, not in the input callback, so
+ * waiting here for the BLE sender to drain only holds up the next key.
+ */
+static int pin_queue_put(const struct pmodkypd_data_t *pmodkypd_data)
+{
+    int64_t deadline = k_uptime_get() + PIN_QUEUE_TIMEOUT_MS;
+    int err;
+
+    while ((err = door_queue_put(&PMODKYPD_queue, pmodkypd_data)) == -ENOBUFS &&
+           k_uptime_get() < deadline) {
+        k_sleep(K_MSEC(PIN_QUEUE_RETRY_MS));
+    }
+    return err;
+}
 
 void PmodKyodInit(void)
 {
-    cols[0] = pmodkypd_col1;
-    cols[1] = pmodkypd_col2;
-    cols[2] = pmodkypd_col3;
-    cols[3] = pmodkypd_col4;
-
-    rows[0] = pmodkypd_row1;
-    rows[1] = pmodkypd_row2;
-    rows[2] = pmodkypd_row3;
-    rows[3] = pmodkypd_row4;
     gpio_pin_configure_dt(&led0, GPIO_OUTPUT_INACTIVE);
 
-    for (int i = 0; i < 4; i++) {
-        int ret;
-    
-        ret = gpio_pin_configure_dt(&cols[i], GPIO_OUTPUT_HIGH);
-        if (ret != 0) {
-            printk("Failed to configure col %d: %d\n", i, ret);
-        }
-    
-        ret = gpio_pin_configure_dt(&rows[i], GPIO_INPUT | GPIO_PULL_UP);
-        if (ret != 0) {
-            printk("Failed to configure row %d: %d\n", i, ret);
-        }
+    if (!device_is_ready(DEVICE_DT_GET(PMODKYPD_NODE))) {
+        printk("PmodKypd matrix not ready\n");
+        return;
     }
-    for (int i = 0; i < 4; i++) {
-        int val = gpio_pin_get_dt(&rows[i]);
-        printk("Initial row[%d] = %d\n", i, val);
-    }
-    
 
     printk("PmodKypd Initialized\n");
 }
 
-
-const char *keymap[4][4] = {
-    {"1", "2", "3", "A"},
-    {"4", "5", "6", "B"},
-    {"7", "8", "9", "C"},
-    {"0", "F", "E", "D"},
-};
 void PmodKypdListener(void)
 {
     PmodKyodInit();
@@ -85,73 +146,62 @@ void PmodKypdListener(void)
     bool waiting_for_F = true;
 
     while (1) {
-        for (int col = 0; col < 4; col++) {
-            gpio_pin_set_dt(&cols[col], 0);
-
-            for (int row = 0; row < 4; row++) {
-                if (gpio_pin_get_dt(&rows[row]) == 0) {
-                    const char *key = keymap[row][col];
-
-                    // Debounce wait
-                    k_msleep(200);
-
-                    // Print every key pressed
-                    printk("Button pressed: %s\n", key);
-
-                    if (waiting_for_F) {
-                        if (strcmp(key, "F") == 0) {
-                            // Blink LED0 once
-                            gpio_pin_set_dt(&led0, 1);
-                            k_msleep(150);
-                            gpio_pin_set_dt(&led0, 0);
-
-                            printk("Please type in a 5-digit pin code.\n");
-                            waiting_for_F = false;
-                            pin_index = 0;
-                        }
-                    } else {
-                        if (pin_index < 5) {
-                            pin_code[pin_index++] = key[0];
-                            printk("Digit %d: %c\n", pin_index, key[0]);
-
-                            // Blink LED1 once
-                            gpio_pin_set_dt(&led0, 1);
-                            k_msleep(50);
-                            gpio_pin_set_dt(&led0, 0);
-                        }
-
-                        if (pin_index == 5) {
-                            pin_code[5] = '\0';
-                            printk("PIN entered: %s\n", pin_code);
-
-                            struct pmodkypd_data_t *pmodkypd_data = k_malloc(sizeof(struct pmodkypd_data_t));
-                            if (!pmodkypd_data) {
-                                printk("Failed to allocate memory for pmodkypd data\n");
-                                continue;
-                            }
-                            memcpy(pmodkypd_data->pin_code, pin_code, sizeof(pin_code));
-                            k_fifo_put(&PMODKYPD_fifo, pmodkypd_data);
-
-                            // Turn on both LEDs for 3 seconds
-                            gpio_pin_set_dt(&led0, 1);
-                            k_sleep(K_SECONDS(3));
-                            gpio_pin_set_dt(&led0, 0);
-
-                            waiting_for_F = true;
-                        }
-                    }
-
-
-                    // Wait until key is released before continuing
-                    while (gpio_pin_get_dt(&rows[row]) == 0) {
-                        k_msleep(10);
-                    }
-                }
-            }
+        struct key_event key_event;
+
+        // Sleeps until the matrix driver reports a key
+        k_msgq_get(&key_msgq, &key_event, K_FOREVER);
+
+        uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - key_event.reported_at);
+        pmodkypd_stats.events++;
+        pmodkypd_stats.latency_total_us += latency_us;
+        if (latency_us > pmodkypd_stats.latency_max_us) {
+            pmodkypd_stats.latency_max_us = latency_us;
+        }
 
-            gpio_pin_set_dt(&cols[col], 1);
+        if (key_event.row >= ARRAY_SIZE(keymap) || key_event.col >= ARRAY_SIZE(keymap[0])) {
+            continue;
         }
+        const char *key = keymap[key_event.row][key_event.col];
+
+        // Print every key pressed
+        printk("Button pressed: %s\n", key);
+
+        if (waiting_for_F) {
+            if (strcmp(key, "F") == 0) {
+                led_blink(BLINK_START_MS);
+                // Keep the radio link fast while someone is at the keypad
+                set_conn_profile(CONN_PROFILE_FAST);
+
+                printk("Please type in a 5-digit pin code.\n");
+                waiting_for_F = false;
+                pin_index = 0;
+            }
+        } else {
+            if (pin_index < 5) {
+                pin_code[pin_index++] = key[0];
+                printk("Digit %d: %c\n", pin_index, key[0]);
+                set_conn_profile(CONN_PROFILE_FAST);
+
+                led_blink(BLINK_DIGIT_MS);
+            }
 
-        k_msleep(50);
+            if (pin_index == 5) {
+                pin_code[5] = '\0';
+                printk("PIN entered: %s\n", pin_code);
+
+                struct pmodkypd_data_t pmodkypd_data;
+                memcpy(pmodkypd_data.pin_code, pin_code, sizeof(pin_code));
+                if (pin_queue_put(&pmodkypd_data) == 0) {
+                    // LED stays on for 3 seconds while the next key is already being accepted
+                    led_blink(BLINK_PIN_DONE_MS);
+                } else {
+                    pmodkypd_stats.pins_dropped++;
+                    printk("PIN not sent, event queue full; please try again\n");
+                    led_error();
+                }
+
+                waiting_for_F = true;
+            }
+        }
     }
 }
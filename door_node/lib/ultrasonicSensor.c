@@ -1,83 +1,62 @@
- #include "ultrasonicSensor.h"
+#include "ultrasonicSensor.h"
 #include <zephyr/device.h>
-#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/sensor.h>
 #include <zephyr/kernel.h>
-#include <zephyr/autoconf.h>
-#include <zephyr/bluetooth/bluetooth.h>
-#include <zephyr/bluetooth/addr.h>
 #include "localVariables.h"
-#include <zephyr/sys_clock.h> 
 #include <stdbool.h>
 
-// Define nodes for data and clock
-#define ULTRASONIC_TRIGGER_NODE  DT_ALIAS(ultrasonictrig)
-#define ULTRASONIC_ECHO_NODE DT_ALIAS(ultrasonicecho)
-
-// Initialize global gpio_dt_spec structures
-struct gpio_dt_spec ultrasonic_trig = GPIO_DT_SPEC_GET(ULTRASONIC_TRIGGER_NODE, gpios);
-struct gpio_dt_spec ultrasonic_echo = GPIO_DT_SPEC_GET(ULTRASONIC_ECHO_NODE, gpios);
+#define ULTRASONIC_NEAR_CM          30
+#define ULTRASONIC_SAMPLE_INTERVAL  K_MSEC(500)
+#define ULTRASONIC_RETRY_INTERVAL   K_MSEC(50)
 
 /**
- * @brief Initialize the ultrasonic sensor
- * 
- * This function configures the GPIO pins for the ultrasonic sensor.
- * The trigger pin is set as output and the echo pin is set as input.
+ * @brief Read the ultrasonic sensor and publish proximity changes
+ *
+ * Measurements go through the HC-SR04 sensor driver, which times the
+ * echo from GPIO interrupts and gives up after the configured maximum
+ * range, so a missing echo can no longer hang this thread.
  */
-void UltrasonicSensorInit(void)
-{
-    // Configure the trigger pin as output
-    gpio_pin_configure_dt(&ultrasonic_trig, GPIO_OUTPUT_INACTIVE);
-    
-    // Configure the echo pin as input
-    gpio_pin_configure_dt(&ultrasonic_echo, GPIO_INPUT);
-    printk("Ultrasonic Sensor Initialized\n");
-}
-
-
-
 void UltrasonicSensorRead(void)
 {
-    UltrasonicSensorInit();
+    const struct device *dev = DEVICE_DT_GET_ONE(slarm_hc_sr04);
+    if (!device_is_ready(dev)) {
+        printk("Ultrasonic sensor not ready\n");
+        return;
+    }
+
+    printk("Ultrasonic Sensor Initialized\n");
     bool was_near = false;
 
     while (1) {
-        gpio_pin_set_dt(&ultrasonic_trig, 0);
-        k_busy_wait(2);
-        gpio_pin_set_dt(&ultrasonic_trig, 1);
-        k_busy_wait(10);
-        gpio_pin_set_dt(&ultrasonic_trig, 0);
-
-        while (!gpio_pin_get_dt(&ultrasonic_echo)) { }
-        uint32_t start = k_cycle_get_32();
-
-        while (gpio_pin_get_dt(&ultrasonic_echo)) { }
-        uint32_t end = k_cycle_get_32();
+        struct sensor_value distance;
 
-        uint32_t cycles = end - start;
-        uint64_t duration_us = (uint64_t)cycles * 1000000U / CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC;
-        uint32_t dist_cm = duration_us / 58;
+        int ret = sensor_sample_fetch(dev);
+        if (ret == 0) {
+            ret = sensor_channel_get(dev, SENSOR_CHAN_DISTANCE, &distance);
+        }
+        if (ret < 0) {
+            // No echo inside the maximum range (or echo still busy): nothing to report
+            k_sleep(ULTRASONIC_RETRY_INTERVAL);
+            continue;
+        }
 
+        int dist_cm = distance.val1 * 100 + distance.val2 / 10000;
 
-        bool is_near = dist_cm <= 30;
+        bool is_near = dist_cm <= ULTRASONIC_NEAR_CM;
         if (is_near != was_near) {
-            was_near = is_near;
-
-            struct ultrasonic_data_t *ultrasonic_data = k_malloc(sizeof(struct ultrasonic_data_t));
-            if (!ultrasonic_data) {
-                printk("Failed to allocate memory for ultrasonic data\n");
-            } else {
-                ultrasonic_data->proximity = is_near;
-                k_fifo_put(&ULTRASONIC_fifo, ultrasonic_data);
+            struct ultrasonic_data_t ultrasonic_data = {
+                .proximity = is_near,
+            };
+            // A refused change is offered again with the next reading
+            if (door_queue_put(&ULTRASONIC_queue, &ultrasonic_data) == 0) {
+                was_near = is_near;
             }
         }
-        struct ultrasonic_sample_data_t *sample_data = k_malloc(sizeof(struct ultrasonic_sample_data_t));
-        if (!sample_data) {
-            printk("Failed to allocate memory for ultrasonic sample data\n");
-        } else {
 
-            sample_data->distance_cm = dist_cm;
-            k_fifo_put(&ULTRASONIC_SAMPLE_fifo, sample_data);
-        }
-        k_sleep(K_MSEC(500));
+        struct ultrasonic_sample_data_t sample_data = {
+            .distance_cm = dist_cm,
+        };
+        door_queue_put(&ULTRASONIC_SAMPLE_queue, &sample_data);
+        k_sleep(ULTRASONIC_SAMPLE_INTERVAL);
     }
 }
@@ -0,0 +1,47 @@
+#ifndef ENVADVERTISEMENT_H
+#define ENVADVERTISEMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Thingy:52 environmental broadcast, carried as manufacturer data.
+ *
+ * Version 1 (16 bytes, little endian):
+ *
+ *   +---------+-----+-----+------+-----+-------+----------+------+-------+
+ *   | company | ver | seq | temp | hum | press | lps temp | eCO2 | eTVOC |
+ *   |   u16   | u8  | u8  | s16  | u16 |  u16  |   s16    | u16  |  u16  |
+ *   +---------+-----+-----+------+-----+-------+----------+------+-------+
+ *
+ * Temperatures are in 0.01 degC, humidity in 0.01 %RH, pressure in
+ * 0.01 kPa, eCO2 in ppm and eTVOC in ppb. seq advances once per new
+ * reading, so repeats and gaps are visible to the scanner.
+ *
+ * The legacy format (company id followed by six IEEE floats, 26 bytes)
+ * has no version byte and is told apart by its length. A legacy
+ * payload holding a NaN or infinity is rejected with -EPROTO.
+ */
+#define ENV_ADV_COMPANY_ID  0xFFFF
+#define ENV_ADV_VERSION     1
+#define ENV_ADV_LEN         16
+#define ENV_ADV_LEGACY_LEN  (2 + 6 * sizeof(float))
+
+struct env_sample {
+    int16_t temp_centi_c;
+    uint16_t humidity_centi_pct;
+    uint16_t pressure_centi_kpa;
+    int16_t lps_temp_centi_c;
+    uint16_t eco2_ppm;
+    uint16_t etvoc_ppb;
+    uint8_t seq;
+    bool has_seq;       /* false for legacy payloads */
+};
+
+/* Returns the encoded length, or -ENOMEM if buf is too small. */
+int env_adv_encode(const struct env_sample *sample, uint8_t *buf, size_t size);
+/* Returns 0, or -EPROTO if the payload is not a known version for our company id. */
+int env_adv_decode(const uint8_t *buf, size_t len, struct env_sample *sample);
+
+#endif // ENVADVERTISEMENT_H
@@ -0,0 +1,70 @@
+#ifndef MSGPROTOCOL_H
+#define MSGPROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Binary door <-> base message format.
+ *
+ * A frame is one version byte followed by one or more type-length-value
+ * records:
+ *
+ *   +---------+------+-----+-------+------+-----+-------+---
+ *   | version | type | len | value | type | len | value | ...
+ *   +---------+------+-----+-------+------+-----+-------+---
+ *
+ * Multi-byte values are little endian. Unknown record types are skipped
+ * by the reader so older base nodes keep working with newer door nodes.
+ */
+#define MSG_PROTOCOL_VERSION    1
+#define MSG_HEADER_LEN          1
+#define MSG_RECORD_HEADER_LEN   2
+#define MSG_PIN_LEN             5
+#define MSG_MAX_RECORD_LEN      (MSG_RECORD_HEADER_LEN + MSG_PIN_LEN)
+
+enum msg_type {
+    MSG_TYPE_PIN                 = 0x01, /* MSG_PIN_LEN ASCII digits */
+    MSG_TYPE_PROXIMITY           = 0x02, /* u8, 1 = someone near the door */
+    MSG_TYPE_DOOR_OPEN           = 0x03, /* u8, 1 = door opened */
+    MSG_TYPE_LOCK_STATE          = 0x05, /* u8, 1 = locked (base node telemetry and host link commands) */
+    MSG_TYPE_ULTRASONIC_SAMPLE   = 0x10, /* s16, distance in cm */
+    MSG_TYPE_MAGNETOMETER_SAMPLE = 0x11, /* s16, average field in centigauss */
+};
+
+struct msg_writer {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+};
+
+struct msg_reader {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+};
+
+struct msg_record {
+    uint8_t type;
+    uint8_t len;
+    const uint8_t *value;
+};
+
+/* Encoding. All put functions return 0, or -ENOMEM if the record does not fit. */
+void msg_writer_init(struct msg_writer *writer, uint8_t *buf, size_t size);
+int msg_put_u8(struct msg_writer *writer, uint8_t type, uint8_t value);
+int msg_put_s16(struct msg_writer *writer, uint8_t type, int32_t value);
+int msg_put_bytes(struct msg_writer *writer, uint8_t type, const void *value, uint8_t len);
+bool msg_writer_empty(const struct msg_writer *writer);
+size_t msg_writer_space(const struct msg_writer *writer);
+
+/* Decoding. Returns 0, or -EPROTO if the frame has an unknown version. */
+int msg_reader_init(struct msg_reader *reader, const uint8_t *buf, size_t len);
+/* Returns 1 when a record was read, 0 at the end of the frame, -EBADMSG if truncated. */
+int msg_reader_next(struct msg_reader *reader, struct msg_record *record);
+
+uint8_t msg_record_u8(const struct msg_record *record);
+int16_t msg_record_s16(const struct msg_record *record);
+
+#endif // MSGPROTOCOL_H
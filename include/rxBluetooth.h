@@ -1,13 +1,25 @@
-
 #ifndef RXBLUETOOTH_H
 #define RXBLUETOOTH_H
 
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
 #include <zephyr/bluetooth/uuid.h>
 
+#define RX_MSG_MAX_LEN  244    /* ATT MTU 247 minus the write header */
+#define RX_QUEUE_LEN    8
+
+struct rx_msg {
+    uint32_t timestamp; /* k_cycle_get_32() when the write arrived */
+    uint8_t conn_index; /* bt_conn_index() of the writer */
+    bt_addr_le_t peer;  /* writer's address; its identity address once bonded */
+    uint16_t len;
+    uint8_t data[RX_MSG_MAX_LEN];
+};
 
 extern struct bt_uuid_128 rx_device_service_uuid;
 extern struct bt_uuid_128 rx_device_char_uuid;
-const char *get_received_data(void);
+int get_received_msg(struct rx_msg *msg, k_timeout_t timeout);
+uint32_t get_rx_dropped_count(void);
 void bluetooth_advertiser(void);
 
 #endif // RXBLUETOOTH_H
@@ -1,16 +1,73 @@
 
 #ifndef TXBLUETOOTH_H
 #define TXBLUETOOTH_H
+#include <zephyr/kernel.h>
 #include <zephyr/bluetooth/uuid.h>
 
 extern struct bt_uuid_128 tx_device_service_uuid;
 extern struct bt_uuid_128 tx_device_char_uuid;
 extern char device_name[];
 extern uint16_t discovered_handle;
-extern volatile bool discovery_ready;
 
+#define TX_MSG_MAX_LEN      244    /* ATT MTU 247 minus the write header */
+
+/* Scan duty cycle in 0.625 ms units; override from the build to trade reconnect time for power */
+#ifndef TX_SCAN_INTERVAL
+#define TX_SCAN_INTERVAL    0x00a0  /* 100 ms */
+#endif
+#ifndef TX_SCAN_WINDOW
+#define TX_SCAN_WINDOW      0x0030  /* 30 ms */
+#endif
+/* How long to look only for bonded peers before also matching by name */
+#define TX_SCAN_BONDED_TIMEOUT_MS   10000
+#define TX_QUEUE_LEN        8
+#define TX_MAX_IN_FLIGHT    4
+#define TX_RETRY_MS         20     /* wait before resending a write the peer had no room for */
+
+enum tx_mode {
+    TX_MODE_ACKED,      /* one acknowledged write at a time */
+    TX_MODE_PIPELINED,  /* up to TX_MAX_IN_FLIGHT writes without response */
+};
+
+enum conn_profile {
+    CONN_PROFILE_FAST,          /* short interval, no peripheral latency: unlock in progress */
+    CONN_PROFILE_POWER_SAVE,    /* long interval with peripheral latency: idle telemetry */
+    CONN_PROFILE_COUNT,
+};
+
+/* Fast mode falls back to power save after this long without another request */
+#define CONN_PROFILE_IDLE_MS    3000
+
+struct conn_profile_stats {
+    enum conn_profile profile;  /* CONN_PROFILE_COUNT while disconnected */
+    uint32_t interval_us;       /* as negotiated by the controller */
+    uint16_t latency;
+    uint16_t timeout_ms;
+    uint32_t time_ms[CONN_PROFILE_COUNT];
+    uint32_t switches;
+};
+
+struct tx_stats {
+    uint32_t queued;
+    uint32_t completed;
+    uint32_t failed;        /* write errors, and writes still in flight when the link dropped */
+    uint32_t rejected;      /* send_msg calls refused because the queue was full */
+    uint32_t retried;       /* acknowledged writes the peer had no room for, sent again */
+    uint32_t in_flight;
+    uint32_t msgs_per_sec;  /* completions since the previous get_tx_stats call */
+};
 
 void bluetooth_scanner(void);
-void send_msg(const char *msg);
+int wait_for_discovery(k_timeout_t timeout);
+void set_tx_mode(enum tx_mode mode);
+/* Called from the BT stack once the message tagged tag has gone out (acked writes: once acknowledged) */
+typedef void (*tx_sent_cb_t)(uint32_t tag);
+
+void set_tx_sent_cb(tx_sent_cb_t cb);
+int send_msg(const uint8_t *data, uint16_t len, uint32_t tag);
+uint16_t get_tx_payload_max(void);
+void get_tx_stats(struct tx_stats *stats);
+void set_conn_profile(enum conn_profile profile);
+void get_conn_profile_stats(struct conn_profile_stats *stats);
 
 #endif // TXBLUETOOTH_H
\ No newline at end of file
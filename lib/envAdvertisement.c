@@ -0,0 +1,82 @@
+#include "envAdvertisement.h"
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+int env_adv_encode(const struct env_sample *sample, uint8_t *buf, size_t size) {
+    if (size < ENV_ADV_LEN) {
+        return -ENOMEM;
+    }
+
+    sys_put_le16(ENV_ADV_COMPANY_ID, &buf[0]);
+    buf[2] = ENV_ADV_VERSION;
+    buf[3] = sample->seq;
+    sys_put_le16((uint16_t)sample->temp_centi_c, &buf[4]);
+    sys_put_le16(sample->humidity_centi_pct, &buf[6]);
+    sys_put_le16(sample->pressure_centi_kpa, &buf[8]);
+    sys_put_le16((uint16_t)sample->lps_temp_centi_c, &buf[10]);
+    sys_put_le16(sample->eco2_ppm, &buf[12]);
+    sys_put_le16(sample->etvoc_ppb, &buf[14]);
+
+    return ENV_ADV_LEN;
+}
+
+/* Clamped while still a float: casting an out-of-range float is undefined */
+static int32_t float_to_centi(float value, int32_t min, int32_t max) {
+    float scaled = value * 100.0f;
+
+    scaled += scaled < 0 ? -0.5f : 0.5f;
+    return (int32_t)CLAMP(scaled, (float)min, (float)max);
+}
+
+static int32_t float_to_whole(float value, int32_t max) {
+    return (int32_t)CLAMP(value + 0.5f, 0.0f, (float)max);
+}
+
+static int decode_legacy(const uint8_t *buf, struct env_sample *sample) {
+    float values[6];
+
+    memcpy(values, &buf[2], sizeof(values));
+    for (size_t i = 0; i < ARRAY_SIZE(values); i++) {
+        if (isnan(values[i]) || isinf(values[i])) {
+            return -EPROTO;
+        }
+    }
+
+    sample->temp_centi_c = float_to_centi(values[0], INT16_MIN, INT16_MAX);
+    sample->humidity_centi_pct = float_to_centi(values[1], 0, UINT16_MAX);
+    sample->pressure_centi_kpa = float_to_centi(values[2], 0, UINT16_MAX);
+    sample->lps_temp_centi_c = float_to_centi(values[3], INT16_MIN, INT16_MAX);
+    sample->eco2_ppm = float_to_whole(values[4], UINT16_MAX);
+    sample->etvoc_ppb = float_to_whole(values[5], UINT16_MAX);
+    sample->seq = 0;
+    sample->has_seq = false;
+    return 0;
+}
+
+int env_adv_decode(const uint8_t *buf, size_t len, struct env_sample *sample) {
+    if (len < 2 || sys_get_le16(buf) != ENV_ADV_COMPANY_ID) {
+        return -EPROTO;
+    }
+
+    if (len == ENV_ADV_LEGACY_LEN) {
+        return decode_legacy(buf, sample);
+    }
+
+    if (len < ENV_ADV_LEN || buf[2] != ENV_ADV_VERSION) {
+        return -EPROTO;
+    }
+
+    sample->seq = buf[3];
+    sample->has_seq = true;
+    sample->temp_centi_c = (int16_t)sys_get_le16(&buf[4]);
+    sample->humidity_centi_pct = sys_get_le16(&buf[6]);
+    sample->pressure_centi_kpa = sys_get_le16(&buf[8]);
+    sample->lps_temp_centi_c = (int16_t)sys_get_le16(&buf[10]);
+    sample->eco2_ppm = sys_get_le16(&buf[12]);
+    sample->etvoc_ppb = sys_get_le16(&buf[14]);
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "msgProtocol.h"
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <string.h>
+
+void msg_writer_init(struct msg_writer *writer, uint8_t *buf, size_t size) {
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+
+    if (size >= MSG_HEADER_LEN) {
+        writer->buf[0] = MSG_PROTOCOL_VERSION;
+        writer->len = MSG_HEADER_LEN;
+    }
+}
+
+static uint8_t *msg_put_record(struct msg_writer *writer, uint8_t type, uint8_t len) {
+    if (writer->len == 0 || writer->len + MSG_RECORD_HEADER_LEN + len > writer->size) {
+        return NULL;
+    }
+
+    uint8_t *p = &writer->buf[writer->len];
+    p[0] = type;
+    p[1] = len;
+    writer->len += MSG_RECORD_HEADER_LEN + len;
+
+    return &p[MSG_RECORD_HEADER_LEN];
+}
+
+int msg_put_u8(struct msg_writer *writer, uint8_t type, uint8_t value) {
+    uint8_t *p = msg_put_record(writer, type, sizeof(uint8_t));
+    if (!p) {
+        return -ENOMEM;
+    }
+
+    *p = value;
+    return 0;
+}
+
+int msg_put_s16(struct msg_writer *writer, uint8_t type, int32_t value) {
+    uint8_t *p = msg_put_record(writer, type, sizeof(int16_t));
+    if (!p) {
+        return -ENOMEM;
+    }
+
+    sys_put_le16((uint16_t)(int16_t)CLAMP(value, INT16_MIN, INT16_MAX), p);
+    return 0;
+}
+
+int msg_put_bytes(struct msg_writer *writer, uint8_t type, const void *value, uint8_t len) {
+    uint8_t *p = msg_put_record(writer, type, len);
+    if (!p) {
+        return -ENOMEM;
+    }
+
+    memcpy(p, value, len);
+    return 0;
+}
+
+bool msg_writer_empty(const struct msg_writer *writer) {
+    return writer->len <= MSG_HEADER_LEN;
+}
+
+size_t msg_writer_space(const struct msg_writer *writer) {
+    return writer->size - writer->len;
+}
+
+int msg_reader_init(struct msg_reader *reader, const uint8_t *buf, size_t len) {
+    reader->buf = buf;
+    reader->len = len;
+    reader->pos = MSG_HEADER_LEN;
+
+    if (len < MSG_HEADER_LEN || buf[0] != MSG_PROTOCOL_VERSION) {
+        return -EPROTO;
+    }
+
+    return 0;
+}
+
+int msg_reader_next(struct msg_reader *reader, struct msg_record *record) {
+    if (reader->pos == reader->len) {
+        return 0;
+    }
+
+    if (reader->pos + MSG_RECORD_HEADER_LEN > reader->len) {
+        return -EBADMSG;
+    }
+
+    const uint8_t *p = &reader->buf[reader->pos];
+    if (reader->pos + MSG_RECORD_HEADER_LEN + p[1] > reader->len) {
+        return -EBADMSG;
+    }
+
+    record->type = p[0];
+    record->len = p[1];
+    record->value = &p[MSG_RECORD_HEADER_LEN];
+    reader->pos += MSG_RECORD_HEADER_LEN + record->len;
+
+    return 1;
+}
+
+uint8_t msg_record_u8(const struct msg_record *record) {
+    return record->len >= sizeof(uint8_t) ? record->value[0] : 0;
+}
+
+int16_t msg_record_s16(const struct msg_record *record) {
+    return record->len >= sizeof(int16_t) ? (int16_t)sys_get_le16(record->value) : 0;
+}
@@ -5,30 +5,50 @@
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <string.h>
 
-static uint8_t data_buffer[20] = "Default msg";
-static char received_data[21]; // +1 for null terminator
+// Last write, mirrored for read_handler; both handlers run on the BT RX thread
+static uint8_t data_buffer[RX_MSG_MAX_LEN] = "Default msg";
+static uint16_t data_len = sizeof("Default msg") - 1;
+
+// Every write is queued so back-to-back (or identical) writes are never lost
+K_MSGQ_DEFINE(rx_msgq, sizeof(struct rx_msg), RX_QUEUE_LEN, 4);
+static atomic_t rx_dropped = ATOMIC_INIT(0);
 
 static ssize_t read_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr,
                          void *buf, uint16_t len, uint16_t offset) {
-    return bt_gatt_attr_read(conn, attr, buf, len, offset, data_buffer, sizeof(data_buffer));
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, data_buffer, data_len);
 }
 
 
 static ssize_t write_handler(struct bt_conn *conn, const struct bt_gatt_attr *attr,
                              const void *buf, uint16_t len, uint16_t offset, uint8_t flags) {
-    // Clamp len to 20 to avoid overflow
-    if (len > sizeof(received_data) - 1) {
-        len = sizeof(received_data) - 1;
-    }
+    struct rx_msg msg;
 
-    memcpy(received_data, buf, len);
-    received_data[len] = '\0'; // Null-terminate for safe string use
+    // Clamp len to the largest frame we negotiate to avoid overflow
+    if (len > sizeof(msg.data)) {
+        len = sizeof(msg.data);
+    }
 
+    msg.timestamp = k_cycle_get_32();
+    msg.conn_index = bt_conn_index(conn);
+    bt_addr_le_copy(&msg.peer, bt_conn_get_dst(conn));
+    msg.len = len;
+    memcpy(msg.data, buf, len);
+
+    if (k_msgq_put(&rx_msgq, &msg, K_NO_WAIT) != 0) {
+        atomic_inc(&rx_dropped);
+        // An acknowledged write can be refused, so the writer keeps the frame and retries
+        if (!(flags & BT_GATT_WRITE_FLAG_CMD)) {
+            return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+        }
+    }
 
     // Optional: also store it in data_buffer if needed for read_handler
-    memcpy(data_buffer, received_data, len + 1);
+    memcpy(data_buffer, msg.data, len);
+    data_len = len;
 
     return len;
 }
@@ -39,26 +59,77 @@ BT_GATT_SERVICE_DEFINE(generic_svc,
     BT_GATT_PRIMARY_SERVICE(&rx_device_service_uuid.uuid),
 
     BT_GATT_CHARACTERISTIC(&rx_device_char_uuid.uuid,
-        BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+        BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
         BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT,
         read_handler, write_handler, NULL),
 );
 
-const char *get_received_data(void) {
-    return received_data;
+/**
+ * Block until the next write arrives (or the timeout expires).
+ * Returns 0 on success, -EAGAIN on timeout.
+ */
+int get_received_msg(struct rx_msg *msg, k_timeout_t timeout) {
+    return k_msgq_get(&rx_msgq, msg, timeout);
 }
 
+uint32_t get_rx_dropped_count(void) {
+    return (uint32_t)atomic_get(&rx_dropped);
+}
+
+static const struct bt_data ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR))
+};
+
+/*
+ * Advertise from the identity address rather than an RPA. Bonded
+ * centrals scan with only their filter accept list, which holds identity
+ * addresses; without link-layer privacy in their controller an RPA would
+ * never match it and they would sit out the whole bonded-scan timeout.
+ */
+#define RX_ADV_PARAM BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_USE_NAME | \
+                                     BT_LE_ADV_OPT_USE_IDENTITY, \
+                                     BT_GAP_ADV_FAST_INT_MIN_2, BT_GAP_ADV_FAST_INT_MAX_2, NULL)
+
+static void adv_work_handler(struct k_work *work) {
+    int err = bt_le_adv_start(RX_ADV_PARAM, ad, ARRAY_SIZE(ad), NULL, 0);
+    if (err == -ENOMEM || err == -EALREADY) {
+        // All connection slots taken (recycled() retries) or already advertising
+        return;
+    }
+
+    if (err) {
+        printk("Advertising failed (err %d)\n", err);
+    } else {
+        printk("Advertising started\n");
+    }
+}
+
+static K_WORK_DEFINE(adv_work, adv_work_handler);
+
 static void connected(struct bt_conn *conn, uint8_t err) {
+    struct bt_conn_info info;
+
     printk("Connected\n");
+
+    // Advertising stops on every peripheral connection; keep accepting more peers
+    if (bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_PERIPHERAL) {
+        k_work_submit(&adv_work);
+    }
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason) {
     printk("Disconnected (reason %u)\n", reason);
 }
 
+// A freed connection object means there is room for another peer again
+static void recycled(void) {
+    k_work_submit(&adv_work);
+}
+
 BT_CONN_CB_DEFINE(conn_callbacks) = {
     .connected = connected,
     .disconnected = disconnected,
+    .recycled = recycled,
 };
 
 void bluetooth_advertiser(void) {
@@ -71,17 +142,10 @@ void bluetooth_advertiser(void) {
     }
 
     printk("Bluetooth initialized\n");
-
-
-    const struct bt_data ad[] = {
-        BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR))
-    };
-
-
-    err = bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
-    if (err) {
-        printk("Advertising failed (err %d)\n", err);
-    } else {
-        printk("Advertising started\n");
+    if (IS_ENABLED(CONFIG_SETTINGS)) {
+        // Restores bonds so returning centrals re-encrypt without pairing again
+        settings_load();
     }
+
+    k_work_submit(&adv_work);
 }
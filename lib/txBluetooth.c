@@ -5,70 +5,555 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/bluetooth/uuid.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
 #include <string.h>
 
+#define GATT_CACHE_KEY_PREFIX   "txbt/gatt"
+#define GATT_CACHE_KEY_LEN      (sizeof(GATT_CACHE_KEY_PREFIX) + 1 + 2 * BT_ADDR_SIZE + 2)
+#define DB_HASH_LEN             16
+
 static struct bt_conn *default_conn;
 uint16_t discovered_handle = 0;
 
+/*
+ * Characteristic handle remembered per bonded peer, together with the
+ * peer's GATT database hash at the time it was discovered. A reconnect
+ * only needs to read the hash back to know the handle is still good.
+ */
+struct gatt_cache {
+    uint16_t value_handle;
+    uint8_t db_hash[DB_HASH_LEN];
+};
+
+enum db_hash_purpose {
+    DB_HASH_VERIFY,     /* compare against the cached entry */
+    DB_HASH_STORE,      /* save alongside a freshly discovered handle */
+};
+
+static struct gatt_cache peer_cache;
+static bool peer_cache_loaded;
+static struct bt_gatt_read_params db_hash_params;
+static enum db_hash_purpose db_hash_purpose;
+static int64_t link_up_ms;
+static int64_t link_down_ms;
+static atomic_t first_tx_pending = ATOMIC_INIT(0);
+
+K_SEM_DEFINE(discovery_sem, 0, 1);
+
 static struct bt_gatt_discover_params discover_params;
 static struct bt_gatt_write_params write_params;
 static uint16_t svc_start_handle = 0, svc_end_handle = 0;
 
+struct tx_msg {
+    uint32_t tag;
+    uint16_t len;
+    uint8_t data[TX_MSG_MAX_LEN];
+};
+
+K_MSGQ_DEFINE(tx_msgq, sizeof(struct tx_msg), TX_QUEUE_LEN, 4);
+
+static void tx_work_handler(struct k_work *work);
+static K_WORK_DEFINE(tx_work, tx_work_handler);
+
+static enum tx_mode tx_mode = TX_MODE_PIPELINED;
+static atomic_t tx_in_flight = ATOMIC_INIT(0);
+
+// Message the stack had no buffer for; retried before anything else in the queue
+static struct tx_msg tx_pending;
+static bool tx_has_pending;
+
+static atomic_t tx_queued = ATOMIC_INIT(0);
+static atomic_t tx_completed = ATOMIC_INIT(0);
+static atomic_t tx_failed = ATOMIC_INIT(0);
+static atomic_t tx_rejected = ATOMIC_INIT(0);
+static atomic_t tx_retried = ATOMIC_INIT(0);
+static tx_sent_cb_t tx_sent_cb;
+static uint32_t acked_tag;
+static uint32_t rate_last_completed;
+static int64_t rate_last_ms;
+
+/* Intervals in 1.25 ms units, supervision timeout in 10 ms units */
+static const struct bt_le_conn_param conn_profile_params[CONN_PROFILE_COUNT] = {
+    [CONN_PROFILE_FAST] = BT_LE_CONN_PARAM_INIT(6, 12, 0, 400),
+    [CONN_PROFILE_POWER_SAVE] = BT_LE_CONN_PARAM_INIT(80, 160, 4, 600),
+};
+
+/*
+ * Profile state is touched from the BT callbacks, the system workqueue
+ * and the shell, so it sits under profile_lock. The lock also covers
+ * swapping default_conn, so the profile work can take its own reference.
+ * profile_current follows what the controller actually runs (updated in
+ * le_param_updated); profile_sent is the last profile asked for.
+ */
+static struct k_spinlock profile_lock;
+static atomic_t profile_requested = ATOMIC_INIT(CONN_PROFILE_FAST);
+static enum conn_profile profile_current = CONN_PROFILE_COUNT;
+static enum conn_profile profile_sent = CONN_PROFILE_COUNT;
+static int64_t profile_since_ms;
+static uint32_t profile_time_ms[CONN_PROFILE_COUNT];
+static uint32_t profile_switches;
+static uint16_t negotiated_interval;
+static uint16_t negotiated_latency;
+static uint16_t negotiated_timeout;
+
+static void tx_done(void) {
+    if (atomic_get(&tx_in_flight) > 0) {
+        atomic_dec(&tx_in_flight);
+    }
+    k_work_submit(&tx_work);
+}
+
+static void tx_completed_one(uint32_t tag) {
+    atomic_inc(&tx_completed);
+    if (tx_sent_cb) {
+        tx_sent_cb(tag);
+    }
+
+    // Reconnect-to-first-message time: scan, connect, security and discovery together
+    if (atomic_cas(&first_tx_pending, 1, 0)) {
+        int64_t now = k_uptime_get();
+
+        printk("First message sent %u ms after connecting", (uint32_t)(now - link_up_ms));
+        if (link_down_ms) {
+            printk(", %u ms after the link dropped", (uint32_t)(now - link_down_ms));
+        }
+        printk("\n");
+    }
+}
+
+static void tx_retry_handler(struct k_work *work) {
+    k_work_submit(&tx_work);
+}
+
+static K_WORK_DELAYABLE_DEFINE(tx_retry_work, tx_retry_handler);
 
 static void write_cb(struct bt_conn *conn, uint8_t err, struct bt_gatt_write_params *params) {
+    if (err == BT_ATT_ERR_INSUFFICIENT_RESOURCES) {
+        // The peer's receive queue was full. The only acked write in flight is
+        // still in tx_pending, so put it back at the head and try again shortly.
+        tx_has_pending = true;
+        atomic_inc(&tx_retried);
+        atomic_dec(&tx_in_flight);
+        k_work_reschedule(&tx_retry_work, K_MSEC(TX_RETRY_MS));
+        return;
+    }
+
     if (err) {
         printk("Write failed: 0x%02x\n", err);
+        atomic_inc(&tx_failed);
+    } else {
+        tx_completed_one(acked_tag);
+    }
+    tx_done();
+}
+
+/* Runs once the controller has sent the write, so the tag travels in user_data */
+static void write_without_rsp_cb(struct bt_conn *conn, void *user_data) {
+    tx_completed_one((uint32_t)(uintptr_t)user_data);
+    tx_done();
+}
+
+static int tx_write(const struct tx_msg *msg) {
+    if (tx_mode == TX_MODE_ACKED) {
+        // Only one acknowledged write is ever in flight, so write_params is not shared
+        write_params.handle = discovered_handle;
+        write_params.offset = 0;
+        write_params.data = msg->data;
+        write_params.length = msg->len;
+        write_params.func = write_cb;
+        acked_tag = msg->tag;
+        return bt_gatt_write(default_conn, &write_params);
     }
+
+    return bt_gatt_write_without_response_cb(default_conn, discovered_handle, msg->data,
+                                             msg->len, false, write_without_rsp_cb,
+                                             (void *)(uintptr_t)msg->tag);
 }
 
-void send_msg(const char *msg) {
+/**
+ * Drain the outbound queue while the link has credits left.
+ * Runs on the system workqueue; re-submitted by send_msg and by every
+ * TX completion, so there is no polling.
+ */
+static void tx_work_handler(struct k_work *work) {
+    int limit = tx_mode == TX_MODE_ACKED ? 1 : TX_MAX_IN_FLIGHT;
+
+    while (default_conn && discovered_handle && atomic_get(&tx_in_flight) < limit) {
+        if (!tx_has_pending) {
+            if (k_msgq_get(&tx_msgq, &tx_pending, K_NO_WAIT) != 0) {
+                return;
+            }
+            tx_has_pending = true;
+        }
+
+        atomic_inc(&tx_in_flight);
+        int err = tx_write(&tx_pending);
+        if (err == -ENOMEM || err == -EAGAIN) {
+            // Out of ATT buffers; the next completion resubmits this work
+            atomic_dec(&tx_in_flight);
+            return;
+        }
+
+        tx_has_pending = false;
+        if (err) {
+            printk("GATT write failed (err %d)\n", err);
+            atomic_dec(&tx_in_flight);
+            atomic_inc(&tx_failed);
+        }
+    }
+}
+
+void set_tx_mode(enum tx_mode mode) {
+    tx_mode = mode;
+    k_work_submit(&tx_work);
+}
+
+/* Set once at start-up, before the first send_msg */
+void set_tx_sent_cb(tx_sent_cb_t cb) {
+    tx_sent_cb = cb;
+}
+
+/**
+ * Queue a message for the discovered characteristic.
+ * Returns 0 when queued, -ENOTCONN before discovery, -EMSGSIZE if the
+ * message is too long, or -ENOBUFS when the outbound queue is full
+ * (backpressure: the caller should retry later). tag is handed to the
+ * tx_sent_cb once the message has gone out.
+ */
+int send_msg(const uint8_t *data, uint16_t len, uint32_t tag) {
     if (!discovered_handle) {
         printk("Characteristic handle not discovered yet.\n");
+        return -ENOTCONN;
+    }
+
+    struct tx_msg msg;
+    if (len > get_tx_payload_max()) {
+        return -EMSGSIZE;
+    }
+
+    msg.tag = tag;
+    msg.len = len;
+    memcpy(msg.data, data, len);
+
+    if (k_msgq_put(&tx_msgq, &msg, K_NO_WAIT) != 0) {
+        atomic_inc(&tx_rejected);
+        return -ENOBUFS;
+    }
+
+    atomic_inc(&tx_queued);
+    k_work_submit(&tx_work);
+    return 0;
+}
+
+/**
+ * Largest message send_msg accepts on the current link: the negotiated
+ * ATT MTU minus the 3-byte write header, capped at TX_MSG_MAX_LEN.
+ * Returns 0 while disconnected.
+ */
+uint16_t get_tx_payload_max(void) {
+    struct bt_conn *conn = default_conn;
+    if (!conn) {
+        return 0;
+    }
+
+    return MIN(bt_gatt_get_mtu(conn) - 3, TX_MSG_MAX_LEN);
+}
+
+void get_tx_stats(struct tx_stats *stats) {
+    int64_t now = k_uptime_get();
+    uint32_t completed = (uint32_t)atomic_get(&tx_completed);
+
+    stats->queued = (uint32_t)atomic_get(&tx_queued);
+    stats->completed = completed;
+    stats->failed = (uint32_t)atomic_get(&tx_failed);
+    stats->rejected = (uint32_t)atomic_get(&tx_rejected);
+    stats->retried = (uint32_t)atomic_get(&tx_retried);
+    stats->in_flight = (uint32_t)atomic_get(&tx_in_flight);
+    stats->msgs_per_sec = 0;
+
+    if (rate_last_ms && now > rate_last_ms) {
+        stats->msgs_per_sec = (uint32_t)((uint64_t)(completed - rate_last_completed) * 1000U /
+                                         (uint64_t)(now - rate_last_ms));
+    }
+    rate_last_completed = completed;
+    rate_last_ms = now;
+}
+
+/* Call with profile_lock held */
+static void profile_account(enum conn_profile next) {
+    int64_t now = k_uptime_get();
+
+    if (profile_current < CONN_PROFILE_COUNT) {
+        profile_time_ms[profile_current] += (uint32_t)(now - profile_since_ms);
+        if (next < CONN_PROFILE_COUNT && next != profile_current) {
+            profile_switches++;
+        }
+    }
+    profile_current = next;
+    profile_since_ms = now;
+}
+
+/* The controller may settle anywhere in a profile's range; anything slower than fast is power save */
+static enum conn_profile profile_for_interval(uint16_t interval) {
+    return interval <= conn_profile_params[CONN_PROFILE_FAST].interval_max ?
+           CONN_PROFILE_FAST : CONN_PROFILE_POWER_SAVE;
+}
+
+/* Ask the controller for a profile; the switch is accounted once le_param_updated reports it */
+static void profile_apply(enum conn_profile profile) {
+    struct bt_conn *conn = NULL;
+    k_spinlock_key_t key = k_spin_lock(&profile_lock);
+
+    if (default_conn && profile != profile_sent && profile_current != CONN_PROFILE_COUNT) {
+        conn = bt_conn_ref(default_conn);
+    }
+    k_spin_unlock(&profile_lock, key);
+
+    if (!conn) {
+        return;
+    }
+
+    int err = bt_conn_le_param_update(conn, &conn_profile_params[profile]);
+    if (err) {
+        printk("Connection parameter update failed (err %d)\n", err);
+    } else {
+        key = k_spin_lock(&profile_lock);
+        profile_sent = profile;
+        k_spin_unlock(&profile_lock, key);
+    }
+    bt_conn_unref(conn);
+}
+
+static void profile_work_handler(struct k_work *work) {
+    profile_apply((enum conn_profile)atomic_get(&profile_requested));
+}
+
+static void profile_idle_handler(struct k_work *work) {
+    atomic_set(&profile_requested, CONN_PROFILE_POWER_SAVE);
+    profile_apply(CONN_PROFILE_POWER_SAVE);
+}
+
+static K_WORK_DEFINE(profile_work, profile_work_handler);
+static K_WORK_DELAYABLE_DEFINE(profile_idle_work, profile_idle_handler);
+
+/**
+ * Switch the link to a connection-parameter profile. Fast mode is held
+ * for CONN_PROFILE_IDLE_MS after the latest request, then the link drops
+ * back to power save on its own. Safe to call from any thread; repeated
+ * fast requests only push the idle deadline out.
+ */
+void set_conn_profile(enum conn_profile profile) {
+    atomic_set(&profile_requested, profile);
+
+    if (profile == CONN_PROFILE_FAST) {
+        k_work_reschedule(&profile_idle_work, K_MSEC(CONN_PROFILE_IDLE_MS));
+    } else {
+        k_work_cancel_delayable(&profile_idle_work);
+    }
+    k_work_submit(&profile_work);
+}
+
+void get_conn_profile_stats(struct conn_profile_stats *stats) {
+    k_spinlock_key_t key = k_spin_lock(&profile_lock);
+    int64_t now = k_uptime_get();
+
+    stats->profile = profile_current;
+    stats->interval_us = negotiated_interval * 1250U;
+    stats->latency = negotiated_latency;
+    stats->timeout_ms = negotiated_timeout * 10U;
+    stats->switches = profile_switches;
+    for (int i = 0; i < CONN_PROFILE_COUNT; i++) {
+        stats->time_ms[i] = profile_time_ms[i];
+    }
+    if (profile_current < CONN_PROFILE_COUNT) {
+        stats->time_ms[profile_current] += (uint32_t)(now - profile_since_ms);
+    }
+    k_spin_unlock(&profile_lock, key);
+}
+
+static void gatt_cache_key(const bt_addr_le_t *addr, char *key, size_t size) {
+    snprintk(key, size, GATT_CACHE_KEY_PREFIX "/%02x%02x%02x%02x%02x%02x%u",
+             addr->a.val[5], addr->a.val[4], addr->a.val[3],
+             addr->a.val[2], addr->a.val[1], addr->a.val[0], addr->type);
+}
+
+static int gatt_cache_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+                              void *cb_arg, void *param) {
+    if (len != sizeof(peer_cache) || read_cb(cb_arg, &peer_cache, len) != len) {
+        return -EINVAL;
+    }
+
+    peer_cache_loaded = true;
+    return 0;
+}
+
+static void gatt_cache_load(struct bt_conn *conn) {
+    char key[GATT_CACHE_KEY_LEN];
+
+    peer_cache_loaded = false;
+    if (!IS_ENABLED(CONFIG_SETTINGS)) {
         return;
     }
 
-    write_params.handle = discovered_handle;
-    write_params.offset = 0;
-    write_params.data = msg;
-    write_params.length = strlen(msg);
-    write_params.func = write_cb;
+    gatt_cache_key(bt_conn_get_dst(conn), key, sizeof(key));
+    settings_load_subtree_direct(key, gatt_cache_load_cb, NULL);
+}
 
+static void gatt_cache_store(struct bt_conn *conn, const uint8_t *db_hash) {
+    char key[GATT_CACHE_KEY_LEN];
 
-    int err = bt_gatt_write(default_conn, &write_params);
+    if (!IS_ENABLED(CONFIG_SETTINGS)) {
+        return;
+    }
+
+    peer_cache.value_handle = discovered_handle;
+    memcpy(peer_cache.db_hash, db_hash, DB_HASH_LEN);
+
+    gatt_cache_key(bt_conn_get_dst(conn), key, sizeof(key));
+    int err = settings_save_one(key, &peer_cache, sizeof(peer_cache));
     if (err) {
-        printk("bt_gatt_write failed (err %d)\n", err);
+        printk("Failed to cache GATT handle (err %d)\n", err);
     }
 }
-static bool adv_data_has_name(struct net_buf_simple *ad, const char *target_name) {
-    while (ad->len > 1) {
-        uint8_t len = net_buf_simple_pull_u8(ad);
-        if (len == 0 || len > ad->len) break;
 
-        uint8_t type = net_buf_simple_pull_u8(ad);
-        if ((type == BT_DATA_NAME_COMPLETE || type == BT_DATA_NAME_SHORTENED) &&
-            len - 1 == strlen(target_name) &&
-            memcmp(ad->data, target_name, len - 1) == 0) {
-            printk("Found match: %.*s\n", len - 1, ad->data);
+/* The write handle is known: release waiters and anything queued meanwhile */
+static void link_ready(const char *how) {
+    printk("Link ready in %u ms (%s handle 0x%04x)\n",
+           (uint32_t)(k_uptime_get() - link_up_ms), how, discovered_handle);
+    k_sem_give(&discovery_sem);
+    k_work_submit(&tx_work);
+}
+
+/**
+ * Block until the peer's characteristic handle is known.
+ * Returns 0 when it is, or -EAGAIN on timeout.
+ */
+int wait_for_discovery(k_timeout_t timeout) {
+    if (discovered_handle) {
+        return 0;
+    }
 
-            return true;
-        }
+    return k_sem_take(&discovery_sem, timeout);
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf_simple *ad);
+
+static bool scan_accept_list_only;
+static size_t device_name_len;
+
+static void scan_fallback_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(scan_fallback_work, scan_fallback_handler);
+
+static void add_bonded_peer(const struct bt_bond_info *info, void *user_data) {
+    size_t *count = user_data;
+
+    int err = bt_le_filter_accept_list_add(&info->addr);
+    if (err) {
+        printk("Accept list add failed (err %d)\n", err);
+        return;
+    }
+    (*count)++;
+}
+
+/*
+ * With bonded peers on record the controller only reports their
+ * advertisements, and no name matching is needed at all. Without bonds
+ * (or once the fallback fires) every connectable advertiser is checked
+ * by name. Both run at the TX_SCAN_INTERVAL/TX_SCAN_WINDOW duty cycle.
+ */
+static void scan_start_mode(bool accept_list_only) {
+    size_t bonded = 0;
+
+    if (accept_list_only && IS_ENABLED(CONFIG_BT_FILTER_ACCEPT_LIST)) {
+        bt_le_filter_accept_list_clear();
+        bt_foreach_bond(BT_ID_DEFAULT, add_bonded_peer, &bonded);
+    }
+
+    scan_accept_list_only = bonded > 0;
+    struct bt_le_scan_param scan_param = {
+        .type = scan_accept_list_only ? BT_HCI_LE_SCAN_PASSIVE : BT_HCI_LE_SCAN_ACTIVE,
+        .options = scan_accept_list_only ? BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST : BT_LE_SCAN_OPT_NONE,
+        .interval = TX_SCAN_INTERVAL,
+        .window = TX_SCAN_WINDOW,
+    };
+
+    int err = bt_le_scan_start(&scan_param, device_found);
+    if (err) {
+        printk("Scan start failed (err %d)\n", err);
+        return;
+    }
 
-        net_buf_simple_pull(ad, len - 1);
+    if (scan_accept_list_only) {
+        printk("Scanning for %u bonded peer(s)...\n", bonded);
+        // A wiped or replaced peer would never show up; widen the search eventually
+        k_work_reschedule(&scan_fallback_work, K_MSEC(TX_SCAN_BONDED_TIMEOUT_MS));
+    } else {
+        printk("Scanning...\n");
     }
-    return false;
 }
+
+static void scan_start(void) {
+    scan_start_mode(true);
+}
+
+static void scan_fallback_handler(struct k_work *work) {
+    if (default_conn || !scan_accept_list_only) {
+        return;
+    }
+
+    printk("No bonded peer seen, scanning by name\n");
+    bt_le_scan_stop();
+    scan_start_mode(false);
+}
+
+static void scan_work_handler(struct k_work *work) {
+    scan_start();
+}
+
+static K_WORK_DEFINE(scan_work, scan_work_handler);
+
+static bool adv_name_matches(struct bt_data *data, void *user_data) {
+    bool *found = user_data;
+
+    if ((data->type == BT_DATA_NAME_COMPLETE || data->type == BT_DATA_NAME_SHORTENED) &&
+        data->data_len == device_name_len &&
+        memcmp(data->data, device_name, device_name_len) == 0) {
+        *found = true;
+        return false;
+    }
+    return true;
+}
+
 static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type, struct net_buf_simple *ad) {
-    if (adv_data_has_name(ad, device_name)) {
-        char addr_str[BT_ADDR_LE_STR_LEN];
-        bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
-        printk("Found node: %s (RSSI %d)\n", addr_str, rssi);
-
-        bt_le_scan_stop();
-        struct bt_le_conn_param *param = BT_LE_CONN_PARAM_DEFAULT;
-        int err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, param, &default_conn);
-        if (err) {
-            printk("Connection failed (err %d)\n", err);
+    if (!scan_accept_list_only) {
+        // Only connectable advertisers (and their scan responses, which carry the name) qualify
+        if (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND &&
+            type != BT_GAP_ADV_TYPE_SCAN_RSP) {
+            return;
+        }
+
+        bool found = false;
+        bt_data_parse(ad, adv_name_matches, &found);
+        if (!found) {
+            return;
         }
+    } else if (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND) {
+        return;
+    }
+
+    char addr_str[BT_ADDR_LE_STR_LEN];
+    bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+    printk("Found node: %s (RSSI %d)\n", addr_str, rssi);
+
+    k_work_cancel_delayable(&scan_fallback_work);
+    bt_le_scan_stop();
+    // Start fast so discovery and pairing finish quickly; idle drops it to power save
+    int err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN,
+                                &conn_profile_params[CONN_PROFILE_FAST], &default_conn);
+    if (err) {
+        printk("Connection failed (err %d)\n", err);
+        k_work_submit(&scan_work);
     }
 }
 
@@ -88,14 +573,103 @@ static struct bt_conn_auth_cb auth_cb = {
     .pairing_confirm = auth_pairing_confirm,
 };
 
+static void mtu_exchange_cb(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params) {
+    if (err) {
+        printk("MTU exchange failed (err %u)\n", err);
+    } else {
+        printk("ATT MTU negotiated: %u\n", bt_gatt_get_mtu(conn));
+    }
+}
+
+static struct bt_gatt_exchange_params mtu_exchange_params = {
+    .func = mtu_exchange_cb,
+};
+
+/* Ask for the largest ATT MTU and LE data length so a whole batch of samples fits one PDU */
+static void request_large_pdus(struct bt_conn *conn) {
+    int err = bt_gatt_exchange_mtu(conn, &mtu_exchange_params);
+    if (err && err != -EALREADY) {
+        printk("MTU exchange request failed (err %d)\n", err);
+    }
+
+    err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        printk("Data length update failed (err %d)\n", err);
+    }
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info) {
+    printk("LE data length: tx %u bytes, rx %u bytes\n", info->tx_max_len, info->rx_max_len);
+}
+
+static bool is_central(struct bt_conn *conn) {
+    struct bt_conn_info info;
+
+    return bt_conn_get_info(conn, &info) == 0 && info.role == BT_CONN_ROLE_CENTRAL;
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+    if (!is_central(conn)) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&profile_lock);
+    negotiated_interval = interval;
+    negotiated_latency = latency;
+    negotiated_timeout = timeout;
+    profile_account(profile_for_interval(interval));
+    k_spin_unlock(&profile_lock, key);
+
+    printk("Connection interval %u us, latency %u, timeout %u ms\n",
+           interval * 1250U, latency, timeout * 10U);
+}
+
 static void connected(struct bt_conn *conn, uint8_t err) {
     if (err) {
         printk("Connection failed (err %u)\n", err);
+        if (conn == default_conn) {
+            k_spinlock_key_t key = k_spin_lock(&profile_lock);
+            default_conn = NULL;
+            k_spin_unlock(&profile_lock, key);
+
+            bt_conn_unref(conn);
+            k_work_submit(&scan_work);
+        }
+        return;
+    }
+
+    // Links where we are the peripheral belong to rxBluetooth
+    if (!is_central(conn)) {
         return;
     }
 
-    default_conn = bt_conn_ref(conn);  // ✅ Properly store connection
+    // bt_conn_le_create already handed us a reference; taking another would leak the object
+    if (default_conn != conn) {
+        struct bt_conn *ref = bt_conn_ref(conn);
+        k_spinlock_key_t key = k_spin_lock(&profile_lock);
+        default_conn = ref;
+        k_spin_unlock(&profile_lock, key);
+    }
     printk("Connected\n");
+    link_up_ms = k_uptime_get();
+    atomic_set(&first_tx_pending, 1);
+    k_sem_reset(&discovery_sem);
+    gatt_cache_load(conn);
+
+    // The link comes up on the fast parameters bt_conn_le_create asked for
+    struct bt_conn_info info;
+    k_spinlock_key_t key = k_spin_lock(&profile_lock);
+    if (bt_conn_get_info(conn, &info) == 0) {
+        negotiated_interval = info.le.interval;
+        negotiated_latency = info.le.latency;
+        negotiated_timeout = info.le.timeout;
+    }
+    profile_account(profile_for_interval(negotiated_interval));
+    profile_sent = CONN_PROFILE_FAST;
+    k_spin_unlock(&profile_lock, key);
+    set_conn_profile(CONN_PROFILE_FAST);
+
+    request_large_pdus(conn);
 
     int auth_err = bt_conn_set_security(conn, BT_SECURITY_L2);
     if (auth_err) {
@@ -104,17 +678,76 @@ static void connected(struct bt_conn *conn, uint8_t err) {
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason) {
+    if (!is_central(conn)) {
+        return;
+    }
+
     printk("Disconnected (reason %u)\n", reason);
-    if (default_conn) {
-        bt_conn_unref(default_conn);
-        default_conn = NULL;
+    link_down_ms = k_uptime_get();
+    k_spinlock_key_t key = k_spin_lock(&profile_lock);
+    struct bt_conn *old = default_conn;
+    default_conn = NULL;
+    profile_account(CONN_PROFILE_COUNT);
+    profile_sent = CONN_PROFILE_COUNT;
+    k_spin_unlock(&profile_lock, key);
+
+    if (old) {
+        bt_conn_unref(old);
     }
+    k_work_cancel_delayable(&profile_idle_work);
+
+    // Writes in flight die with the link and count as failed; queued ones (and
+    // tx_pending) wait for the next connection instead of being thrown away
+    discovered_handle = 0;
+    atomic_add(&tx_failed, atomic_set(&tx_in_flight, 0));
+
+    k_work_submit(&scan_work);
 }
 
-BT_CONN_CB_DEFINE(conn_callbacks) = {
-    .connected = connected,
-    .disconnected = disconnected,
-};
+
+static void discover_device_char(struct bt_conn *conn);
+
+static uint8_t db_hash_read_cb(struct bt_conn *conn, uint8_t err,
+                               struct bt_gatt_read_params *params,
+                               const void *data, uint16_t length) {
+    bool have_hash = !err && data && length == DB_HASH_LEN;
+
+    if (db_hash_purpose == DB_HASH_STORE) {
+        // Servers without Robust Caching have no hash; the handle is then rediscovered each time
+        if (have_hash) {
+            gatt_cache_store(conn, data);
+        }
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (have_hash && memcmp(data, peer_cache.db_hash, DB_HASH_LEN) == 0) {
+        discovered_handle = peer_cache.value_handle;
+        link_ready("cached");
+    } else {
+        printk("Peer GATT database changed, rediscovering\n");
+        discover_device_char(conn);
+    }
+    return BT_GATT_ITER_STOP;
+}
+
+static void read_db_hash(struct bt_conn *conn, enum db_hash_purpose purpose) {
+    db_hash_purpose = purpose;
+
+    memset(&db_hash_params, 0, sizeof(db_hash_params));
+    db_hash_params.func = db_hash_read_cb;
+    db_hash_params.handle_count = 0;
+    db_hash_params.by_uuid.uuid = BT_UUID_GATT_DB_HASH;
+    db_hash_params.by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+    db_hash_params.by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+
+    int err = bt_gatt_read(conn, &db_hash_params);
+    if (err) {
+        printk("DB hash read failed (err %d)\n", err);
+        if (purpose == DB_HASH_VERIFY) {
+            discover_device_char(conn);
+        }
+    }
+}
 
 static uint8_t discover_char_func(struct bt_conn *conn, const struct bt_gatt_attr *attr, struct bt_gatt_discover_params *params) {
     if (!attr) {
@@ -126,6 +759,9 @@ static uint8_t discover_char_func(struct bt_conn *conn, const struct bt_gatt_att
     if (bt_uuid_cmp(chrc->uuid, &tx_device_char_uuid.uuid) == 0) {
         discovered_handle = chrc->value_handle;
         printk("Discovered characteristic handle: 0x%04x\n", discovered_handle);
+        link_ready("discovered");
+        read_db_hash(conn, DB_HASH_STORE);
+        return BT_GATT_ITER_STOP;
     }
 
     return BT_GATT_ITER_CONTINUE;
@@ -161,26 +797,57 @@ static uint8_t discover_service_func(struct bt_conn *conn, const struct bt_gatt_
 }
 
 
-void discover_device_char(void) {
+static void discover_device_char(struct bt_conn *conn) {
     memset(&discover_params, 0, sizeof(discover_params));
     discover_params.uuid = &tx_device_service_uuid.uuid;
     discover_params.func = discover_service_func;
-    discover_params.start_handle = 0x0001;
-    discover_params.end_handle = 0xffff;
+    discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+    discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
     discover_params.type = BT_GATT_DISCOVER_PRIMARY;
 
-    int err = bt_gatt_discover(default_conn, &discover_params);
+    int err = bt_gatt_discover(conn, &discover_params);
     if (err) {
         printk("Service discovery failed (err %d)\n", err);
     }
 }
 
-volatile bool discovery_ready = false;
+/*
+ * Runs for fresh pairings and for bonded reconnects alike (which never
+ * see pairing_complete). The peer's characteristic needs encryption, so
+ * this is the earliest point a write can succeed.
+ */
+static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err) {
+    if (conn != default_conn || discovered_handle) {
+        return;
+    }
+
+    if (err || level < BT_SECURITY_L2) {
+        printk("Security failed (level %u, err %d)\n", level, err);
+        return;
+    }
+
+    // Bonded peers were loaded at connect time; an identity resolved during pairing is looked up again
+    if (!peer_cache_loaded) {
+        gatt_cache_load(conn);
+    }
+
+    if (peer_cache_loaded) {
+        read_db_hash(conn, DB_HASH_VERIFY);
+    } else {
+        discover_device_char(conn);
+    }
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+    .le_data_len_updated = le_data_len_updated,
+    .le_param_updated = le_param_updated,
+    .security_changed = security_changed,
+};
 
 static void pairing_complete(struct bt_conn *conn, bool bonded) {
     printk("Pairing complete, bonded: %d\n", bonded);
-    discover_device_char();
-    discovery_ready = true;  // ✅ Set flag when discovery is initiated
 }
 
 static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason) {
@@ -193,7 +860,6 @@ static struct bt_conn_auth_info_cb auth_info_cb = {
     .pairing_failed = pairing_failed,
 };
 
-
 void bluetooth_scanner(void) {
     int err = bt_enable(NULL);
     if (err && err != -120) {
@@ -202,21 +868,14 @@ void bluetooth_scanner(void) {
     }
 
     printk("Bluetooth initialized\n");
+    if (IS_ENABLED(CONFIG_SETTINGS)) {
+        // Restores bonds, so known peers re-encrypt without pairing again
+        settings_load();
+    }
+
     bt_conn_auth_cb_register(&auth_cb); 
     bt_conn_auth_info_cb_register(&auth_info_cb);
 
-    struct bt_le_scan_param scan_param = {
-        .type = BT_HCI_LE_SCAN_ACTIVE,
-        .options = BT_LE_SCAN_OPT_NONE,
-        .interval = 0x0010,
-        .window = 0x0010,
-    };
-
-    err = bt_le_scan_start(&scan_param, device_found);
-    if (err) {
-        printk("Scan start failed (err %d)\n", err);
-    } else {
-        printk("Scanning...\n");
-    }
+    device_name_len = strlen(device_name);
+    scan_start();
 }
-
@@ -3,61 +3,186 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/shell/shell.h>
+#include <zephyr/spinlock.h>
 
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/bluetooth/addr.h>
 #include <zephyr/bluetooth/scan.h>
 
 #include <zephyr/net/buf.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "envAdvertisement.h"
+
 LOG_MODULE_REGISTER(base_node, LOG_LEVEL_INF);
 
-#define COMPANY_ID     0xFFFF
-#define SENSOR_COUNT   6
+/* registry sizing: memory is fixed however many devices advertise */
+#define MAX_SENSORS         8
+#define HISTORY_LEN         16
+/* log a given sensor at most this often */
+#define LOG_INTERVAL_MS     10000
 
-/* buffer for latest floats */
-static float latest[SENSOR_COUNT];
-static bool  seen = false;
+struct sensor_sample {
+    int64_t at_ms;
+    struct env_sample env;
+};
 
-/* scan callback: look for manufacturer data == COMPANY_ID */
-static void scan_cb(const bt_addr_le_t *addr, int8_t rssi,
-                    uint8_t adv_type, struct net_buf_simple *buf)
+/* one broadcaster, keyed by its address; history is a ring of distinct readings */
+struct sensor_entry {
+    bool used;
+    bt_addr_le_t addr;
+    int8_t rssi;
+    int64_t last_seen_ms;
+    int64_t last_log_ms;
+    uint32_t adverts;
+    uint32_t duplicates;
+    uint32_t received;  /* distinct sequence numbers seen */
+    uint32_t lost;      /* sequence numbers skipped */
+    uint8_t head;
+    uint8_t count;
+    struct sensor_sample history[HISTORY_LEN];
+};
+
+static struct sensor_entry registry[MAX_SENSORS];
+static struct k_spinlock registry_lock;
+static uint32_t evictions;
+/* slot of the sensor heard most recently, or -1 */
+static int last_updated = -1;
+
+/* Find the slot for addr, claiming a free one or evicting the least recently seen */
+static struct sensor_entry *registry_slot(const bt_addr_le_t *addr)
 {
-    struct net_buf_simple_state state;
-    net_buf_simple_save(buf, &state);
+    struct sensor_entry *oldest = &registry[0];
+    struct sensor_entry *free_slot = NULL;
+
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        struct sensor_entry *entry = &registry[i];
 
-    while (buf->len > 1) {
-        uint8_t field_len = net_buf_simple_pull_u8(buf);
-        if (field_len < 1) {
-            break;
+        if (!entry->used) {
+            if (!free_slot) {
+                free_slot = entry;
+            }
+            continue;
+        }
+        if (bt_addr_le_eq(&entry->addr, addr)) {
+            return entry;
         }
-        uint8_t ad_type = net_buf_simple_pull_u8(buf);
-
-        if (ad_type == BT_DATA_MANUFACTURER_DATA
-            && field_len >= 2 + SENSOR_COUNT * sizeof(float)) {
-            uint8_t *data = buf->data;
-            uint16_t comp = data[0] | (data[1] << 8);
-            if (comp == COMPANY_ID) {
-                for (int i = 0; i < SENSOR_COUNT; i++) {
-                    memcpy(&latest[i],
-                           &data[2 + i * sizeof(float)],
-                           sizeof(float));
-                }
-                seen = true;
-
-                char addr_str[BT_ADDR_LE_STR_LEN];
-                bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
-                LOG_INF("Update from %s RSSI %d", addr_str, rssi);
-                break;
+        if (entry->last_seen_ms < oldest->last_seen_ms) {
+            oldest = entry;
+        }
+    }
+
+    struct sensor_entry *slot = free_slot;
+    if (!slot) {
+        slot = oldest;
+        evictions++;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    bt_addr_le_copy(&slot->addr, addr);
+    return slot;
+}
+
+static bool same_reading(const struct env_sample *a, const struct env_sample *b)
+{
+    if (a->has_seq && b->has_seq) {
+        return a->seq == b->seq;
+    }
+
+    // Legacy payloads carry no counter; compare the readings themselves
+    return a->temp_centi_c == b->temp_centi_c &&
+           a->humidity_centi_pct == b->humidity_centi_pct &&
+           a->pressure_centi_kpa == b->pressure_centi_kpa &&
+           a->lps_temp_centi_c == b->lps_temp_centi_c &&
+           a->eco2_ppm == b->eco2_ppm &&
+           a->etvoc_ppb == b->etvoc_ppb;
+}
+
+/* Record one broadcast; returns true when this sensor is due a log line */
+static bool registry_update(const bt_addr_le_t *addr, int8_t rssi,
+                            const struct env_sample *env)
+{
+    int64_t now = k_uptime_get();
+    bool log_due = false;
+    k_spinlock_key_t key = k_spin_lock(&registry_lock);
+
+    struct sensor_entry *entry = registry_slot(addr);
+    entry->rssi = rssi;
+    entry->last_seen_ms = now;
+    entry->adverts++;
+    last_updated = entry - registry;
+
+    const struct sensor_sample *newest = entry->count ?
+        &entry->history[(entry->head + HISTORY_LEN - 1) % HISTORY_LEN] : NULL;
+
+    // Broadcasters repeat the same reading many times; keep each reading once
+    if (newest && same_reading(&newest->env, env)) {
+        entry->duplicates++;
+    } else {
+        struct sensor_sample *sample = &entry->history[entry->head];
+
+        if (newest && newest->env.has_seq && env->has_seq) {
+            uint8_t gap = env->seq - newest->env.seq - 1;
+            // A jump of half the counter range or more is a restarted broadcaster
+            if (gap < 128) {
+                entry->lost += gap;
             }
         }
+        entry->received++;
+
+        sample->at_ms = now;
+        sample->env = *env;
+        entry->head = (entry->head + 1) % HISTORY_LEN;
+        if (entry->count < HISTORY_LEN) {
+            entry->count++;
+        }
+    }
 
-        /* skip remainder of this AD field */
-        net_buf_simple_pull(buf, field_len - 1);
+    if (!entry->last_log_ms || now - entry->last_log_ms >= LOG_INTERVAL_MS) {
+        entry->last_log_ms = now;
+        log_due = true;
     }
 
-    net_buf_simple_restore(buf, &state);
+    k_spin_unlock(&registry_lock, key);
+    return log_due;
+}
+
+struct adv_match {
+    bool found;
+    struct env_sample env;
+};
+
+static bool parse_manufacturer_data(struct bt_data *data, void *user_data)
+{
+    struct adv_match *match = user_data;
+
+    if (data->type != BT_DATA_MANUFACTURER_DATA ||
+        env_adv_decode(data->data, data->data_len, &match->env) != 0) {
+        return true;
+    }
+
+    match->found = true;
+    return false;
+}
+
+/* scan callback: look for manufacturer data == ENV_ADV_COMPANY_ID */
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi,
+                    uint8_t adv_type, struct net_buf_simple *buf)
+{
+    struct adv_match match = { .found = false };
+
+    bt_data_parse(buf, parse_manufacturer_data, &match);
+    if (!match.found) {
+        return;
+    }
+
+    if (registry_update(addr, rssi, &match.env)) {
+        char addr_str[BT_ADDR_LE_STR_LEN];
+        bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
+        LOG_INF("Update from %s RSSI %d", addr_str, rssi);
+    }
 }
 
 /* scan parameters: passive, no duplicate filter */
@@ -68,29 +193,126 @@ static struct bt_le_scan_param scan_param = {
     .window   = BT_GAP_SCAN_FAST_WINDOW,
 };
 
+/* Sign, whole and hundredths of a centi-unit value, for "%s%d.%02d" */
+#define CENTI_ARGS(v)   ((v) < 0 ? "-" : ""), abs(v) / 100, abs(v) % 100
+
+static void print_loss(const struct shell *sh, const struct sensor_entry *entry)
+{
+    uint32_t expected = entry->received + entry->lost;
+    uint32_t loss_permille = expected ? entry->lost * 1000U / expected : 0;
+
+    shell_print(sh, "Packets: %u received, %u lost (%u.%u%%), %u repeats",
+                entry->received, entry->lost, loss_permille / 10,
+                loss_permille % 10, entry->duplicates);
+}
+
+/* Sensor id from argv[1], or the sensor heard most recently */
+static int parse_sensor_id(const struct shell *sh, size_t argc, char **argv)
+{
+    if (argc < 2) {
+        return last_updated;
+    }
+
+    char *end;
+    long id = strtol(argv[1], &end, 10);
+    if (*end != '\0' || id < 0 || id >= MAX_SENSORS || !registry[id].used) {
+        shell_error(sh, "Unknown sensor: %s (see 'list')", argv[1]);
+        return -EINVAL;
+    }
+    return (int)id;
+}
+
 /* shell command: get latest sensor values */
 static int cmd_get(const struct shell *sh, size_t argc, char **argv)
 {
-    if (!seen) {
-        shell_print(sh, "No broadcast received yet");
-        return 0;
+    int id = parse_sensor_id(sh, argc, argv);
+    if (id < 0) {
+        if (argc < 2) {
+            shell_print(sh, "No broadcast received yet");
+            return 0;
+        }
+        return id;
+    }
+
+    struct sensor_entry entry;
+    k_spinlock_key_t key = k_spin_lock(&registry_lock);
+    entry = registry[id];
+    k_spin_unlock(&registry_lock, key);
+
+    const struct env_sample *latest =
+        &entry.history[(entry.head + HISTORY_LEN - 1) % HISTORY_LEN].env;
+    char addr_str[BT_ADDR_LE_STR_LEN];
+    bt_addr_le_to_str(&entry.addr, addr_str, sizeof(addr_str));
+
+    shell_print(sh, "Sensor %d: %s RSSI %d, seen %lld ms ago",
+                id, addr_str, entry.rssi, k_uptime_get() - entry.last_seen_ms);
+    shell_print(sh, "HTS221: Temp = %s%d.%02d °C, Hum = %u.%02u%%",
+                CENTI_ARGS(latest->temp_centi_c),
+                latest->humidity_centi_pct / 100, latest->humidity_centi_pct % 100);
+    shell_print(sh, "LPS22HB: Press = %u.%02u kPa, Temp = %s%d.%02d °C",
+                latest->pressure_centi_kpa / 100, latest->pressure_centi_kpa % 100,
+                CENTI_ARGS(latest->lps_temp_centi_c));
+    shell_print(sh, "CCS811: eCO₂ = %u ppm, eTVOC = %u ppb",
+                latest->eco2_ppm, latest->etvoc_ppb);
+    print_loss(sh, &entry);
+
+    if (argc > 2 && strcmp(argv[2], "history") == 0) {
+        for (int i = entry.count; i > 0; i--) {
+            const struct sensor_sample *sample =
+                &entry.history[(entry.head + HISTORY_LEN - i) % HISTORY_LEN];
+
+            shell_print(sh, "  -%lld ms: seq %u temp %d hum %u press %u temp %d eco2 %u etvoc %u",
+                        entry.last_seen_ms - sample->at_ms, sample->env.seq,
+                        sample->env.temp_centi_c, sample->env.humidity_centi_pct,
+                        sample->env.pressure_centi_kpa, sample->env.lps_temp_centi_c,
+                        sample->env.eco2_ppm, sample->env.etvoc_ppb);
+        }
     }
-    shell_print(sh, "HTS221: Temp = %.2f °C, Hum = %.2f%%",
-                latest[0], latest[1]);
-    shell_print(sh, "LPS22HB: Press = %.2f kPa, Temp = %.2f °C",
-                latest[2], latest[3]);
-    shell_print(sh, "CCS811: eCO₂ = %.0f ppm, eTVOC = %.0f ppb",
-                latest[4], latest[5]);
     return 0;
 }
 SHELL_CMD_REGISTER(get, NULL,
-    "Get last‐seen sensor broadcast",
+    "Get last‐seen sensor broadcast: get [id] [history]",
     cmd_get);
 
+/* shell command: every sensor in the registry */
+static int cmd_list(const struct shell *sh, size_t argc, char **argv)
+{
+    int64_t now = k_uptime_get();
+
+    shell_print(sh, "%-3s %-30s %5s %9s %8s %6s %6s %7s",
+                "id", "address", "rssi", "age_ms", "adverts", "dups", "lost", "samples");
+
+    for (int i = 0; i < MAX_SENSORS; i++) {
+        struct sensor_entry entry;
+
+        // Copy out so the shell never prints with the scanner locked out
+        k_spinlock_key_t key = k_spin_lock(&registry_lock);
+        entry = registry[i];
+        k_spin_unlock(&registry_lock, key);
+
+        if (!entry.used) {
+            continue;
+        }
+
+        char addr_str[BT_ADDR_LE_STR_LEN];
+        bt_addr_le_to_str(&entry.addr, addr_str, sizeof(addr_str));
+        shell_print(sh, "%-3d %-30s %5d %9lld %8u %6u %6u %7u",
+                    i, addr_str, entry.rssi, now - entry.last_seen_ms,
+                    entry.adverts, entry.duplicates, entry.lost, entry.count);
+    }
+    uint32_t evicted = evictions;
+
+    shell_print(sh, "capacity %d sensors, %u evicted", MAX_SENSORS, evicted);
+    return 0;
+}
+SHELL_CMD_REGISTER(list, NULL,
+    "List broadcasting sensors",
+    cmd_list);
+
 /* shell command: have we seen any valid broadcast? */
 static int cmd_seen(const struct shell *sh, size_t argc, char **argv)
 {
-    shell_print(sh, "Broadcast seen: %s", seen ? "YES" : "NO");
+    shell_print(sh, "Broadcast seen: %s", last_updated >= 0 ? "YES" : "NO");
     return 0;
 }
 SHELL_CMD_REGISTER(seen, NULL,